@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "hal/us_ticker_api.h"
+#include "mbed-trace/mbed_trace.h"
+#include "app_event_queues.h"
+
+#define TRACE_GROUP "aEvQ"  //Application Event Queues
+
+#ifdef MBED_CONF_APP_EVENT_QUEUE_DIAG_STACK_SIZE
+#define DIAG_QUEUE_STACK_SIZE               MBED_CONF_APP_EVENT_QUEUE_DIAG_STACK_SIZE
+#else
+#define DIAG_QUEUE_STACK_SIZE               4096
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_QUEUE_DIAG_EVENTS
+#define DIAG_QUEUE_EVENTS                   MBED_CONF_APP_EVENT_QUEUE_DIAG_EVENTS
+#else
+#define DIAG_QUEUE_EVENTS                   32
+#endif
+
+static const char *const app_event_queue_names[] = {"control", "default", "diag"};
+
+static unsigned char diag_queue_buffer[DIAG_QUEUE_EVENTS * EVENTS_EVENT_SIZE];
+static events::EventQueue diag_queue(sizeof(diag_queue_buffer), diag_queue_buffer);
+// Below the shared event queue and the main thread, diagnostics run when control work is done
+static rtos::Thread diag_thread(osPriorityBelowNormal, DIAG_QUEUE_STACK_SIZE, NULL, "diag_queue");
+static bool diag_queue_running = false;
+
+#ifdef MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL
+typedef struct app_event_queue_probe {
+    uint32_t sent_time;
+    volatile bool pending;
+    app_event_queue_backlog_t backlog;
+} app_event_queue_probe_t;
+
+static app_event_queue_probe_t queue_probes[APP_EVENT_QUEUE_COUNT];
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+static app_event_site_t *event_sites = NULL;
+#endif
+
+#if defined(MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL) || defined(MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL)
+static uint32_t app_event_queues_time_ms(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+#else
+    return (uint32_t)Kernel::get_ms_count();
+#endif
+}
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL
+/* Runs in the probed queue, the time from posting is the time spent behind the queued events */
+static void app_event_queue_probe_dispatched(uint8_t id)
+{
+    app_event_queue_probe_t *probe = &queue_probes[id];
+    uint32_t latency = app_event_queues_time_ms() - probe->sent_time;
+
+    probe->backlog.latency = latency;
+    if (latency > probe->backlog.latency_max) {
+        probe->backlog.latency_max = latency;
+    }
+    probe->backlog.probes++;
+    probe->pending = false;
+}
+
+/* Runs in the diagnostics queue */
+static void app_event_queue_probe_send(void)
+{
+    uint32_t time = app_event_queues_time_ms();
+
+    for (uint8_t id = 0; id < APP_EVENT_QUEUE_COUNT; id++) {
+        app_event_queue_probe_t *probe = &queue_probes[id];
+        if (id == APP_EVENT_QUEUE_DIAG && !diag_queue_running) {
+            continue;
+        }
+        // One probe at a time, a probe still waiting is not added to the backlog
+        if (probe->pending) {
+            probe->backlog.stalls++;
+            tr_warn("Event queue %s has not dispatched for %" PRIu32 " ms", app_event_queue_names[id], time - probe->sent_time);
+            continue;
+        }
+        probe->sent_time = time;
+        probe->pending = true;
+        if (app_event_queue_get((app_event_queue_id_t)id)->call(app_event_queue_probe_dispatched, id) == 0) {
+            probe->pending = false;
+        }
+    }
+}
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+/* Decade bin of the value, first bin is below the base */
+static uint8_t app_event_histogram_bin(uint32_t value, uint32_t base)
+{
+    uint8_t bin = 0;
+
+    while (bin < APP_EVENT_HISTOGRAM_BINS - 1 && value >= base) {
+        value /= 10;
+        bin++;
+    }
+    return bin;
+}
+
+static void app_event_site_register(app_event_site_t *site)
+{
+    // Sites are posted from several threads
+    core_util_critical_section_enter();
+    if (!site->registered) {
+        site->registered = true;
+        site->next = event_sites;
+        event_sites = site;
+    }
+    core_util_critical_section_exit();
+}
+
+static void app_event_site_run(app_event_site_t *site, uint32_t expected_time)
+{
+    int32_t lateness = (int32_t)(app_event_queues_time_ms() - expected_time);
+    uint32_t start = us_ticker_read();
+
+    site->function();
+
+    uint32_t runtime = us_ticker_read() - start;
+    app_event_site_stats_t *stats = &site->stats;
+    if (lateness < 0) {
+        lateness = 0;
+    }
+    stats->runs++;
+    if ((uint32_t)lateness > stats->lateness_max) {
+        stats->lateness_max = lateness;
+    }
+    if (runtime > stats->runtime_max) {
+        stats->runtime_max = runtime;
+    }
+    stats->runtime_total += runtime;
+    stats->lateness_histogram[app_event_histogram_bin(lateness, 1)]++;
+    stats->runtime_histogram[app_event_histogram_bin(runtime, 100)]++;
+}
+
+static void app_event_site_once(app_event_site_t *site, uint32_t expected_time)
+{
+    app_event_site_run(site, expected_time);
+}
+
+static void app_event_site_periodic(app_event_site_t *site)
+{
+    // Periodic events are scheduled from the previous target time, not from the dispatch
+    uint32_t expected_time = site->expected_time;
+    site->expected_time += site->period;
+    app_event_site_run(site, expected_time);
+}
+
+static int app_event_site_histogram_print(char *buffer, size_t buffer_size, const uint32_t *histogram)
+{
+    return snprintf(buffer, buffer_size, "%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+                    histogram[0], histogram[1], histogram[2], histogram[3], histogram[4]);
+}
+
+static void app_event_sites_trace(void)
+{
+    char lateness[60];
+    char runtime[60];
+
+    for (app_event_site_t *site = event_sites; site; site = site->next) {
+        app_event_site_stats_t *stats = &site->stats;
+        app_event_site_histogram_print(lateness, sizeof(lateness), stats->lateness_histogram);
+        app_event_site_histogram_print(runtime, sizeof(runtime), stats->runtime_histogram);
+        tr_info("Event %s runs: %" PRIu32 ", late max: %" PRIu32 " ms %s, runtime max: %" PRIu32 " us mean: %" PRIu32 " us %s",
+                site->name, stats->runs, stats->lateness_max, lateness, stats->runtime_max,
+                stats->runs ? (uint32_t)(stats->runtime_total / stats->runs) : 0, runtime);
+        stats->lateness_max = 0;
+        stats->runtime_max = 0;
+    }
+}
+#endif
+
+int app_event_call(events::EventQueue *queue, app_event_site_t *site)
+{
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    app_event_site_register(site);
+    return queue->call(app_event_site_once, site, app_event_queues_time_ms());
+#else
+    return queue->call(site->function);
+#endif
+}
+
+int app_event_call_in(events::EventQueue *queue, app_event_site_t *site, uint32_t delay)
+{
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    app_event_site_register(site);
+#if MBED_MAJOR_VERSION > 5
+    return queue->call_in(std::chrono::milliseconds(delay), app_event_site_once, site, app_event_queues_time_ms() + delay);
+#else
+    return queue->call_in(delay, app_event_site_once, site, app_event_queues_time_ms() + delay);
+#endif
+#else
+#if MBED_MAJOR_VERSION > 5
+    return queue->call_in(std::chrono::milliseconds(delay), site->function);
+#else
+    return queue->call_in(delay, site->function);
+#endif
+#endif
+}
+
+int app_event_call_every(events::EventQueue *queue, app_event_site_t *site, uint32_t period)
+{
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    app_event_site_register(site);
+    // One periodic event per site, the expected time is kept in the site
+    site->period = period;
+    site->expected_time = app_event_queues_time_ms() + period;
+#if MBED_MAJOR_VERSION > 5
+    return queue->call_every(std::chrono::milliseconds(period), mbed::callback(app_event_site_periodic, site));
+#else
+    return queue->call_every(period, mbed::callback(app_event_site_periodic, site));
+#endif
+#else
+#if MBED_MAJOR_VERSION > 5
+    return queue->call_every(std::chrono::milliseconds(period), site->function);
+#else
+    return queue->call_every(period, site->function);
+#endif
+#endif
+}
+
+int app_event_sites_summary_get(char *buffer, size_t buffer_size)
+{
+    int length = 0;
+
+    buffer[0] = '\0';
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    for (app_event_site_t *site = event_sites; site; site = site->next) {
+        app_event_site_stats_t *stats = &site->stats;
+        int written = snprintf(buffer + length, buffer_size - length, "%s %" PRIu32 " %" PRIu32 " ",
+                               site->name, stats->runs, stats->lateness_max);
+        if (written >= 0 && (size_t)written < buffer_size - length) {
+            written += app_event_site_histogram_print(buffer + length + written, buffer_size - length - written, stats->lateness_histogram);
+        }
+        if (written >= 0 && (size_t)written < buffer_size - length) {
+            written += snprintf(buffer + length + written, buffer_size - length - written, " %" PRIu32 " %" PRIu32 " ",
+                                stats->runtime_max, stats->runs ? (uint32_t)(stats->runtime_total / stats->runs) : 0);
+        }
+        if (written >= 0 && (size_t)written < buffer_size - length) {
+            written += app_event_site_histogram_print(buffer + length + written, buffer_size - length - written, stats->runtime_histogram);
+        }
+        if (written >= 0 && (size_t)written + 1 < buffer_size - length) {
+            buffer[length + written] = '\n';
+            length += written + 1;
+            buffer[length] = '\0';
+        } else {
+            // Whole lines only
+            buffer[length] = '\0';
+            break;
+        }
+    }
+#else
+    (void)buffer_size;
+#endif
+    return length;
+}
+
+int app_event_queues_init(void)
+{
+    if (diag_thread.start(mbed::callback(&diag_queue, &events::EventQueue::dispatch_forever)) != osOK) {
+        tr_error("Diagnostics event queue thread cannot be started, using the default queue");
+        return -1;
+    }
+    diag_queue_running = true;
+
+#ifdef MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL
+#if MBED_MAJOR_VERSION > 5
+    if (diag_queue.call_every(std::chrono::milliseconds(MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL), app_event_queue_probe_send) == 0) {
+#else
+    if (diag_queue.call_every(MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL, app_event_queue_probe_send) == 0) {
+#endif
+        tr_error("Event queue backlog probes cannot be scheduled");
+    }
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+#if MBED_MAJOR_VERSION > 5
+    if (diag_queue.call_every(std::chrono::milliseconds(MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL), app_event_sites_trace) == 0) {
+#else
+    if (diag_queue.call_every(MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL, app_event_sites_trace) == 0) {
+#endif
+        tr_error("Event instrumentation summary cannot be scheduled");
+    }
+#endif
+    return 0;
+}
+
+events::EventQueue *app_event_queue_get(app_event_queue_id_t id)
+{
+    switch (id) {
+        case APP_EVENT_QUEUE_CONTROL:
+            return mbed_highprio_event_queue();
+        case APP_EVENT_QUEUE_DIAG:
+            if (diag_queue_running) {
+                return &diag_queue;
+            }
+            break;
+        default:
+            break;
+    }
+    return mbed_event_queue();
+}
+
+void app_event_queue_backlog_get(app_event_queue_id_t id, app_event_queue_backlog_t *backlog)
+{
+    memset(backlog, 0, sizeof(app_event_queue_backlog_t));
+#ifdef MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL
+    if (id < APP_EVENT_QUEUE_COUNT) {
+        *backlog = queue_probes[id].backlog;
+    }
+#else
+    (void)id;
+#endif
+}
+
+void app_event_queues_trace(void)
+{
+#ifdef MBED_CONF_APP_EVENT_QUEUE_PROBE_INTERVAL
+    for (uint8_t id = 0; id < APP_EVENT_QUEUE_COUNT; id++) {
+        app_event_queue_backlog_t *backlog = &queue_probes[id].backlog;
+        tr_info("Event queue %s latency: %" PRIu32 " ms, max: %" PRIu32 " ms, probes: %" PRIu32 ", stalls: %" PRIu32,
+                app_event_queue_names[id], backlog->latency, backlog->latency_max, backlog->probes, backlog->stalls);
+        backlog->latency_max = 0;
+    }
+#endif
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APP_EVENT_QUEUES_H
+#define APP_EVENT_QUEUES_H
+
+typedef enum app_event_queue_id {
+    APP_EVENT_QUEUE_CONTROL = 0,    // High priority shared queue, mesh interface control
+    APP_EVENT_QUEUE_DEFAULT = 1,    // Shared queue, cloud client and application
+    APP_EVENT_QUEUE_DIAG = 2,       // Low priority thread, diagnostics and housekeeping
+    APP_EVENT_QUEUE_COUNT
+} app_event_queue_id_t;
+
+typedef struct app_event_queue_backlog {
+    uint32_t latency;               // Dispatch latency of the last probe in milliseconds
+    uint32_t latency_max;           // Since the previous trace
+    uint32_t probes;                // Probes dispatched
+    uint32_t stalls;                // Probes not dispatched by the next probe interval
+} app_event_queue_backlog_t;
+
+#define APP_EVENT_HISTOGRAM_BINS            5
+
+typedef struct app_event_site_stats {
+    uint32_t runs;
+    uint32_t lateness_max;          // Milliseconds, since the previous trace
+    uint32_t runtime_max;           // Microseconds, since the previous trace
+    uint64_t runtime_total;         // Microseconds
+    // Decade bins, lateness from 1 ms and runtime from 100 us up, last bin is open ended
+    uint32_t lateness_histogram[APP_EVENT_HISTOGRAM_BINS];
+    uint32_t runtime_histogram[APP_EVENT_HISTOGRAM_BINS];
+} app_event_site_stats_t;
+
+/*
+ * Call site of an event callback. When event-instrumentation-interval is set, dispatch lateness and
+ * runtime of the callbacks posted through the site are recorded, otherwise the callback is posted as is.
+ */
+typedef struct app_event_site {
+    const char *name;
+    void (*function)(void);
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    struct app_event_site *next;
+    bool registered;
+    uint32_t period;
+    uint32_t expected_time;         // Next dispatch of a periodic callback
+    app_event_site_stats_t stats;
+#endif
+} app_event_site_t;
+
+#define APP_EVENT_SITE(site, function)      static app_event_site_t site = {#function, function}
+
+/* Posting through a call site, delays in milliseconds. Return the event id or 0 on failure like EventQueue. */
+int app_event_call(events::EventQueue *queue, app_event_site_t *site);
+int app_event_call_in(events::EventQueue *queue, app_event_site_t *site, uint32_t delay);
+int app_event_call_every(events::EventQueue *queue, app_event_site_t *site, uint32_t period);
+
+/*
+ * Writes a line per instrumented call site: name, runs, maximum lateness in ms, lateness histogram,
+ * maximum runtime in us, mean runtime in us and runtime histogram, histogram bins separated by '/'.
+ * Returns length of the summary.
+ */
+int app_event_sites_summary_get(char *buffer, size_t buffer_size);
+
+/*
+ * Starts the low priority diagnostics queue thread, the backlog probes when event-queue-probe-interval is set
+ * and the call site summary trace when event-instrumentation-interval is set. Diagnostics events go to the
+ * default queue if the thread cannot be started.
+ */
+int app_event_queues_init(void);
+
+events::EventQueue *app_event_queue_get(app_event_queue_id_t id);
+
+void app_event_queue_backlog_get(app_event_queue_id_t id, app_event_queue_backlog_t *backlog);
+
+/* Traces the backlog of the queues and restarts the maximum latencies */
+void app_event_queues_trace(void);
+
+#endif /* APP_EVENT_QUEUES_H */
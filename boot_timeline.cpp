@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "mbed-trace/mbed_trace.h"
+#include "boot_timeline.h"
+
+#define TRACE_GROUP "aBoT"  //Application Boot Timeline
+
+#define BOOT_TIMELINE_BIT(phase)            (1UL << (phase))
+
+// Boot is complete when these phases are, the summary is traced then
+#ifdef MBED_CLOUD_CLIENT_SUPPORT_MULTICAST_UPDATE
+#define BOOT_TIMELINE_COMPLETE              (BOOT_TIMELINE_BIT(BOOT_TIMELINE_REGISTERED) | BOOT_TIMELINE_BIT(BOOT_TIMELINE_WISUN_ACTIVE) | \
+                                             BOOT_TIMELINE_BIT(BOOT_TIMELINE_MULTICAST))
+#else
+#define BOOT_TIMELINE_COMPLETE              (BOOT_TIMELINE_BIT(BOOT_TIMELINE_REGISTERED) | BOOT_TIMELINE_BIT(BOOT_TIMELINE_WISUN_ACTIVE))
+#endif
+
+#define BOOT_TIMELINE_SUMMARY_MAX_SIZE      160
+
+static const char *const boot_timeline_names[BOOT_TIMELINE_PHASES] = {
+    "kv", "cfg", "cloud", "bh", "setup", "mesh", "reg", "active", "mc"
+};
+
+static uint32_t boot_timeline_times[BOOT_TIMELINE_PHASES];
+static uint32_t boot_timeline_marked = 0;
+
+static uint32_t boot_timeline_time_ms(void)
+{
+    // Kernel clock starts from zero at boot
+#if MBED_MAJOR_VERSION > 5
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+#else
+    return (uint32_t)Kernel::get_ms_count();
+#endif
+}
+
+void boot_timeline_mark(boot_timeline_phase_t phase)
+{
+    bool complete = false;
+
+    if (phase >= BOOT_TIMELINE_PHASES) {
+        return;
+    }
+
+    // Phases are marked from main, the event queues and the network stack thread
+    core_util_critical_section_enter();
+    if (!(boot_timeline_marked & BOOT_TIMELINE_BIT(phase))) {
+        boot_timeline_times[phase] = boot_timeline_time_ms();
+        boot_timeline_marked |= BOOT_TIMELINE_BIT(phase);
+        // Traced once, when the last of the completing phases is marked
+        complete = (BOOT_TIMELINE_BIT(phase) & BOOT_TIMELINE_COMPLETE) &&
+                   (boot_timeline_marked & BOOT_TIMELINE_COMPLETE) == BOOT_TIMELINE_COMPLETE;
+    }
+    core_util_critical_section_exit();
+
+    if (complete) {
+        char summary[BOOT_TIMELINE_SUMMARY_MAX_SIZE];
+        boot_timeline_get(summary, sizeof(summary));
+        tr_info("Boot timeline ms: %s", summary);
+    }
+}
+
+uint32_t boot_timeline_time_get(boot_timeline_phase_t phase)
+{
+    if (phase >= BOOT_TIMELINE_PHASES || !(boot_timeline_marked & BOOT_TIMELINE_BIT(phase))) {
+        return 0;
+    }
+    return boot_timeline_times[phase];
+}
+
+int boot_timeline_get(char *buffer, size_t buffer_size)
+{
+    int length = 0;
+
+    buffer[0] = '\0';
+    for (uint8_t phase = 0; phase < BOOT_TIMELINE_PHASES; phase++) {
+        if (!(boot_timeline_marked & BOOT_TIMELINE_BIT(phase))) {
+            continue;
+        }
+        int written = snprintf(buffer + length, buffer_size - length, "%s%s=%" PRIu32,
+                               length ? "," : "", boot_timeline_names[phase], boot_timeline_times[phase]);
+        if (written < 0 || (size_t)written >= buffer_size - length) {
+            // Whole pairs only
+            buffer[length] = '\0';
+            break;
+        }
+        length += written;
+    }
+    return length;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+/* Boot phases in the usual order of completion */
+typedef enum boot_timeline_phase {
+    BOOT_TIMELINE_KV_INIT = 0,          // Storage mounted
+    BOOT_TIMELINE_CONFIG_VERIFIED,      // Developer flow and cloud configuration verified
+    BOOT_TIMELINE_CLOUD_INIT,           // Cloud client created
+    BOOT_TIMELINE_BACKHAUL_UP,          // Backhaul connected
+    BOOT_TIMELINE_CLOUD_SETUP,          // Cloud client started
+    BOOT_TIMELINE_MESH_START,           // Mesh interface connect called
+    BOOT_TIMELINE_REGISTERED,           // First registration to Pelion
+    BOOT_TIMELINE_WISUN_ACTIVE,         // Mesh interface global address
+    BOOT_TIMELINE_MULTICAST,            // Multicast update interface configured
+    BOOT_TIMELINE_PHASES
+} boot_timeline_phase_t;
+
+/* Records the completion of the phase in milliseconds from boot, only the first completion is kept */
+void boot_timeline_mark(boot_timeline_phase_t phase);
+
+/* Milliseconds from boot to the completion of the phase, 0 if not completed */
+uint32_t boot_timeline_time_get(boot_timeline_phase_t phase);
+
+/*
+ * Writes the completed phases as "<phase>=<ms>" pairs separated by ',', e.g. "kv=85,cfg=1210,cloud=1302".
+ * Returns length of the timeline.
+ */
+int boot_timeline_get(char *buffer, size_t buffer_size);
+
+#endif /* BOOT_TIMELINE_H */
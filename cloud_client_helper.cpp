@@ -18,9 +18,63 @@
 #include "mbed-cloud-client/MbedCloudClient.h" // Required for new MbedCloudClient()
 #include "factory_configurator_client.h"       // Required for fcc_* functions and FCC_* defines
 #include "mbed-trace/mbed_trace.h"             // Required for mbed_trace_*
+#include "cloud_client_helper.h"
+
+#if defined(MBED_CONF_APP_DEVELOPER_MODE) && (MBED_CONF_APP_DEVELOPER_MODE == 1) && \
+    defined(MBED_CONF_APP_CLOUD_CONFIG_VERIFY_CACHE) && (MBED_CONF_APP_CLOUD_CONFIG_VERIFY_CACHE == 1)
+#define CLOUD_CONFIG_CACHE_ENABLED
+#endif
+
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+#include "key_config_manager.h"
+#include "kvstore_global_api.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+#include "pal.h"
+#endif
 
 #define TRACE_GROUP "CC_h"
 
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+#define CLOUD_CONFIG_CACHE_VERSION          1
+#define CLOUD_CONFIG_DIGEST_SIZE            32
+// Client time before 2020 has not been set, certificate expiry cannot be checked
+#define CLOUD_CONFIG_VALID_TIME             1577836800
+// Marks a missing item in the digest
+#define CLOUD_CONFIG_ITEM_MISSING           0xFFFFFFFF
+
+/* Result of a successful verification, the credentials have not changed when the digest matches */
+typedef struct cloud_config_cache {
+    uint32_t version;
+    uint8_t digest[CLOUD_CONFIG_DIGEST_SIZE];
+    uint64_t not_after;                     // Earliest certificate expiry in seconds from epoch
+} cloud_config_cache_t;
+
+typedef struct cloud_config_item {
+    const char *name;
+    kcm_item_type_e type;
+} cloud_config_item_t;
+
+static const char cloud_config_cache_kv_key[] = "/kv/cloud_cfg_cache_key";
+
+// Items checked by fcc_verify_device_configured_4mbed_cloud()
+static const cloud_config_item_t cloud_config_items[] = {
+    {g_fcc_use_bootstrap_parameter_name,            KCM_CONFIG_ITEM},
+    {g_fcc_endpoint_parameter_name,                 KCM_CONFIG_ITEM},
+    {g_fcc_account_id_parameter_name,               KCM_CONFIG_ITEM},
+    {g_fcc_first_to_claim_parameter_name,           KCM_CONFIG_ITEM},
+    {g_fcc_bootstrap_server_uri_name,               KCM_CONFIG_ITEM},
+    {g_fcc_bootstrap_server_ca_certificate_name,    KCM_CERTIFICATE_ITEM},
+    {g_fcc_bootstrap_device_certificate_name,       KCM_CERTIFICATE_ITEM},
+    {g_fcc_bootstrap_device_private_key_name,       KCM_PRIVATE_KEY_ITEM},
+    {g_fcc_lwm2m_server_uri_name,                   KCM_CONFIG_ITEM},
+    {g_fcc_lwm2m_server_ca_certificate_name,        KCM_CERTIFICATE_ITEM},
+    {g_fcc_lwm2m_device_certificate_name,           KCM_CERTIFICATE_ITEM},
+    {g_fcc_lwm2m_device_private_key_name,           KCM_PRIVATE_KEY_ITEM},
+    {g_fcc_update_authentication_certificate_name,  KCM_CERTIFICATE_ITEM},
+};
+#endif
+
 void print_fcc_status(int fcc_status)
 {
 #ifndef DISABLE_ERROR_DESCRIPTION
@@ -140,10 +194,161 @@ void print_fcc_status(int fcc_status)
 #endif
 }
 
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+static uint64_t cloud_config_epoch_time(const mbedtls_x509_time *time)
+{
+    // Days from 1970-01-01, March based year puts the leap day last
+    uint32_t year = time->year - (time->mon <= 2 ? 1 : 0);
+    uint32_t month = time->mon > 2 ? time->mon - 3 : time->mon + 9;
+    uint32_t days = year * 365 + year / 4 - year / 100 + year / 400 + (153 * month + 2) / 5 + time->day - 1 - 719468;
+
+    return (uint64_t)days * 86400 + time->hour * 3600 + time->min * 60 + time->sec;
+}
+
+/*
+ * SHA-256 over the names, sizes and contents of the credential items. When not_after is given,
+ * the certificates are also parsed for the earliest expiry, which is done only after a verification.
+ */
+static int cloud_config_digest(uint8_t *digest, uint64_t *not_after)
+{
+    mbedtls_sha256_context sha;
+    int result = 0;
+
+    if (not_after) {
+        *not_after = UINT64_MAX;
+    }
+
+    mbedtls_sha256_init(&sha);
+    if (mbedtls_sha256_starts_ret(&sha, 0) != 0) {
+        mbedtls_sha256_free(&sha);
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(cloud_config_items) / sizeof(cloud_config_items[0]) && result == 0; i++) {
+        const cloud_config_item_t *item = &cloud_config_items[i];
+        size_t name_len = strlen(item->name);
+        size_t size = 0;
+        uint8_t *data = NULL;
+        uint32_t hashed_size = CLOUD_CONFIG_ITEM_MISSING;
+        bool hash_data = false;
+
+        kcm_status_e status = kcm_item_get_data_size((const uint8_t *)item->name, name_len, item->type, &size);
+        if (status == KCM_STATUS_SUCCESS) {
+            hashed_size = size;
+            if (size > 0) {
+                data = (uint8_t *)malloc(size);
+                if (!data) {
+                    result = -1;
+                    break;
+                }
+                status = kcm_item_get_data((const uint8_t *)item->name, name_len, item->type, data, size, &size);
+                if (status == KCM_STATUS_SUCCESS) {
+                    hashed_size = size;
+                    hash_data = true;
+                } else if (item->type != KCM_PRIVATE_KEY_ITEM) {
+                    // Private keys that cannot be exported are covered by their size, a new key comes with a new certificate
+                    result = -1;
+                }
+            }
+        } else if (status != KCM_STATUS_ITEM_NOT_FOUND) {
+            result = -1;
+        }
+
+        if (result == 0) {
+            if (mbedtls_sha256_update_ret(&sha, (const unsigned char *)item->name, name_len + 1) != 0 ||
+                    mbedtls_sha256_update_ret(&sha, (const unsigned char *)&hashed_size, sizeof(hashed_size)) != 0 ||
+                    (hash_data && mbedtls_sha256_update_ret(&sha, data, hashed_size) != 0)) {
+                result = -1;
+            }
+        }
+
+        if (result == 0 && not_after && item->type == KCM_CERTIFICATE_ITEM && hash_data) {
+            mbedtls_x509_crt crt;
+            mbedtls_x509_crt_init(&crt);
+            if (mbedtls_x509_crt_parse_der(&crt, data, hashed_size) == 0) {
+                uint64_t expiry = cloud_config_epoch_time(&crt.valid_to);
+                if (expiry < *not_after) {
+                    *not_after = expiry;
+                }
+            }
+            mbedtls_x509_crt_free(&crt);
+        }
+
+        if (data) {
+            memset(data, 0, size);
+            free(data);
+        }
+    }
+
+    if (result == 0 && mbedtls_sha256_finish_ret(&sha, digest) != 0) {
+        result = -1;
+    }
+    mbedtls_sha256_free(&sha);
+    return result;
+}
+
+static bool cloud_config_cache_valid(void)
+{
+    cloud_config_cache_t cache;
+    uint8_t digest[CLOUD_CONFIG_DIGEST_SIZE];
+    size_t actual_size = 0;
+
+    if (kv_get(cloud_config_cache_kv_key, &cache, sizeof(cache), &actual_size) != MBED_SUCCESS ||
+            actual_size != sizeof(cache) || cache.version != CLOUD_CONFIG_CACHE_VERSION) {
+        return false;
+    }
+
+    if (cloud_config_digest(digest, NULL) != 0 || memcmp(digest, cache.digest, sizeof(digest)) != 0) {
+        tr_info("Cloud configuration changed, verifying");
+        return false;
+    }
+
+    // Client time is restored from storage by fcc_init(), it is unknown until it has been set once
+    uint64_t now = pal_osGetTime();
+    if (now < CLOUD_CONFIG_VALID_TIME) {
+        tr_info("Time not known, verifying cloud configuration");
+        return false;
+    }
+    if (now >= cache.not_after) {
+        tr_info("Certificate expired, verifying cloud configuration");
+        return false;
+    }
+    return true;
+}
+
+static void cloud_config_cache_store(void)
+{
+    cloud_config_cache_t cache;
+
+    memset(&cache, 0, sizeof(cache));
+    cache.version = CLOUD_CONFIG_CACHE_VERSION;
+    if (cloud_config_digest(cache.digest, &cache.not_after) != 0) {
+        tr_warn("Cloud configuration digest failed, verification result not cached");
+        return;
+    }
+
+    int kv_status = kv_set(cloud_config_cache_kv_key, &cache, sizeof(cache), 0);
+    if (kv_status != MBED_SUCCESS) {
+        tr_warn("Could not set cloud configuration verification into KVStore, Error: %d", MBED_GET_ERROR_CODE(kv_status));
+    }
+}
+#endif
+
+void cloud_config_cache_clear(void)
+{
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+    int kv_status = kv_remove(cloud_config_cache_kv_key);
+    if (kv_status != MBED_SUCCESS && kv_status != MBED_ERROR_ITEM_NOT_FOUND) {
+        tr_warn("Could not remove cloud configuration verification from KVStore, Error: %d", MBED_GET_ERROR_CODE(kv_status));
+    }
+#endif
+}
+
 int platform_reset_storage(void)
 {
 #if defined(MBED_CONF_APP_DEVELOPER_MODE) && (MBED_CONF_APP_DEVELOPER_MODE == 1)
     printf("Resets storage to an empty state.\r\n");
+    cloud_config_cache_clear();
     int status = fcc_storage_delete();
     if (status != FCC_STATUS_SUCCESS) {
         printf("Failed to delete storage - %d\r\n", status);
@@ -159,6 +364,14 @@ int verify_cloud_config(void)
     int status;
     int result = 0;
 
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+    // Developer credentials are already stored when the verification has been cached
+    if (cloud_config_cache_valid()) {
+        tr_info("Cloud configuration unchanged since last verification, verification skipped");
+        return result;
+    }
+#endif
+
 #if defined(MBED_CONF_APP_DEVELOPER_MODE) && (MBED_CONF_APP_DEVELOPER_MODE == 1)
     status = fcc_developer_flow();
     if (status == FCC_STATUS_KCM_FILE_EXIST_ERROR) {
@@ -175,6 +388,14 @@ int verify_cloud_config(void)
     if (status != FCC_STATUS_SUCCESS && status != FCC_STATUS_EXPIRED_CERTIFICATE) {
         result = -1;
     }
+#ifdef CLOUD_CONFIG_CACHE_ENABLED
+    // Expired certificates are verified on every boot to keep reporting them
+    if (result == 0 && status == FCC_STATUS_SUCCESS) {
+        cloud_config_cache_store();
+    } else {
+        cloud_config_cache_clear();
+    }
+#endif
 #endif
     return result;
 }
@@ -21,4 +21,7 @@ void print_fcc_status(int fcc_status);
 int platform_reset_storage(void);
 int verify_cloud_config(void);
 
+/* Forgets the cached verification result, the next verify_cloud_config() runs the full verification */
+void cloud_config_cache_clear(void);
+
 #endif //CLOUD_CLIENT_HELPER_H
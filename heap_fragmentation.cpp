@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+
+#include "mbed.h"
+#include "ns_types.h"
+// Probes are allocated from nanostack heap without the memory tracker wrappers
+#if NSDYNMEM_TRACKER_ENABLED==1
+#undef NSDYNMEM_TRACKER_ENABLED
+#include "nsdynmemLIB.h"
+#define NSDYNMEM_TRACKER_ENABLED 1
+#else
+#include "nsdynmemLIB.h"
+#endif
+#include "platform/arm_hal_interrupt.h"
+#include "mbed-trace/mbed_trace.h"
+#include "heap_fragmentation.h"
+#include "app_event_queues.h"
+
+#define TRACE_GROUP "aHeF"  //Application Heap Fragmentation
+
+#define HEAP_FRAGMENTATION_STEP_INTERVAL    10      // Milliseconds between probes
+#define HEAP_FRAGMENTATION_GRANULARITY      64      // Bytes, search ends when the range is this small
+#define HEAP_FRAGMENTATION_MBED_MARGIN      4096    // Bytes of mbed heap left for the other threads while probing
+
+/*
+ * Mbed heap probes call the allocator behind the mbed heap statistics wrappers of the toolchain (see
+ * mbed_alloc_wrappers.cpp), so failed probes are not counted as allocation failures and probes do not
+ * raise the MaxSize statistics.
+ */
+#if defined(TOOLCHAIN_GCC)
+#include <reent.h>
+extern "C" {
+    void *__real__malloc_r(struct _reent *r, size_t size);
+    void __real__free_r(struct _reent *r, void *ptr);
+}
+#define HEAP_FRAGMENTATION_MBED_MALLOC(size)    __real__malloc_r(_REENT, size)
+#define HEAP_FRAGMENTATION_MBED_FREE(ptr)       __real__free_r(_REENT, ptr)
+#elif defined(TOOLCHAIN_ARM)
+extern "C" {
+    void *$Super$$malloc(size_t size);
+    void $Super$$free(void *ptr);
+}
+#define HEAP_FRAGMENTATION_MBED_MALLOC(size)    $Super$$malloc(size)
+#define HEAP_FRAGMENTATION_MBED_FREE(ptr)       $Super$$free(ptr)
+#endif
+
+typedef enum heap_fragmentation_state {
+    HEAP_FRAGMENTATION_IDLE,
+    HEAP_FRAGMENTATION_NS_HEAP,
+    HEAP_FRAGMENTATION_MBED_HEAP
+} heap_fragmentation_state_t;
+
+typedef struct heap_probe {
+    heap_fragmentation_stats_t stats;   // Result of the last completed analysis
+    uint32_t free_bytes;
+    uint32_t low;                       // Allocation of this size succeeded
+    uint32_t high;                      // Allocation of this size failed or is above the cap
+    uint32_t cap;                       // Initial high, probes did not reach a failure if high is unchanged
+    bool capped;
+} heap_probe_t;
+
+static events::EventQueue *frag_queue = NULL;
+static heap_fragmentation_done_cb *frag_done_cb = NULL;
+static heap_fragmentation_state_t frag_state = HEAP_FRAGMENTATION_IDLE;
+static heap_probe_t ns_probe;
+static heap_probe_t mbed_probe;
+static bool frag_paused = false;
+
+static void heap_fragmentation_step(void);
+static void heap_fragmentation_analysis_start(void);
+APP_EVENT_SITE(heap_fragmentation_step_site, heap_fragmentation_step);
+APP_EVENT_SITE(heap_fragmentation_start_site, heap_fragmentation_analysis_start);
+
+/*
+ * Allocation and free are done in the nanostack critical section, so no other nanostack allocation can
+ * see the probe. Probe is a long-term allocation from the end of the heap, as most of the heap is used
+ * by those. Statistics are restored after the probe, so probes do not show as allocations, allocation
+ * failures or maximum usage.
+ */
+static bool heap_fragmentation_ns_probe(uint32_t size)
+{
+    mem_stat_t *stat = (mem_stat_t *) ns_dyn_mem_get_mem_stat();
+    mem_stat_t saved_stat;
+
+    platform_enter_critical();
+    saved_stat = *stat;
+    void *block = ns_dyn_mem_alloc(size);
+    if (block) {
+        ns_dyn_mem_free(block);
+    }
+    *stat = saved_stat;
+    platform_exit_critical();
+
+    return block != NULL;
+}
+
+#ifdef HEAP_FRAGMENTATION_MBED_MALLOC
+static bool heap_fragmentation_mbed_probe(uint32_t size)
+{
+    void *block = HEAP_FRAGMENTATION_MBED_MALLOC(size);
+    if (!block) {
+        return false;
+    }
+    HEAP_FRAGMENTATION_MBED_FREE(block);
+    return true;
+}
+#endif
+
+static bool heap_fragmentation_ns_init(void)
+{
+    const mem_stat_t *stat = ns_dyn_mem_get_mem_stat();
+    if (!stat) {
+        return false;
+    }
+
+    ns_probe.free_bytes = stat->heap_sector_size - stat->heap_sector_allocated_bytes;
+    ns_probe.low = 0;
+    ns_probe.high = ns_probe.free_bytes + 1;
+    ns_probe.capped = false;
+    return true;
+}
+
+/*
+ * Mbed heap cannot be locked against the other threads for the probe, so probes are capped to leave
+ * a safety margin of free heap to them. Largest free block is a lower bound when the cap is reached.
+ */
+static bool heap_fragmentation_mbed_init(void)
+{
+#ifndef HEAP_FRAGMENTATION_MBED_MALLOC
+    // Toolchain has no allocator behind the statistics wrappers to probe with
+    return false;
+#else
+    mbed_stats_heap_t heap_stats;
+    mbed_stats_heap_get(&heap_stats);
+    if (heap_stats.reserved_size == 0) {
+        // Heap statistics are not enabled
+        return false;
+    }
+
+    uint32_t used = heap_stats.current_size + heap_stats.overhead_size;
+    mbed_probe.free_bytes = (heap_stats.reserved_size > used) ? heap_stats.reserved_size - used : 0;
+    uint32_t limit = (mbed_probe.free_bytes > HEAP_FRAGMENTATION_MBED_MARGIN) ? mbed_probe.free_bytes - HEAP_FRAGMENTATION_MBED_MARGIN : 0;
+    mbed_probe.low = 0;
+    mbed_probe.high = limit + 1;
+    mbed_probe.capped = limit < mbed_probe.free_bytes;
+    mbed_probe.cap = mbed_probe.high;
+    return true;
+#endif
+}
+
+static void heap_fragmentation_probe_done(heap_probe_t *probe)
+{
+    uint32_t largest = (probe->low > probe->free_bytes) ? probe->free_bytes : probe->low;
+
+    probe->stats.free_bytes = probe->free_bytes;
+    probe->stats.largest_free_block = largest;
+    probe->stats.fragmentation = probe->free_bytes ? 100 - (uint8_t)((uint64_t)largest * 100 / probe->free_bytes) : 0;
+    // Cap was reached if every probe succeeded
+    probe->stats.lower_bound = probe->capped && probe->high == probe->cap;
+    probe->stats.valid = true;
+}
+
+/* One binary search step, returns true when the largest free block is found */
+static bool heap_fragmentation_probe_step(heap_probe_t *probe, bool (*probe_alloc)(uint32_t size))
+{
+    if (probe->high - probe->low <= HEAP_FRAGMENTATION_GRANULARITY) {
+        heap_fragmentation_probe_done(probe);
+        return true;
+    }
+
+    uint32_t size = (probe->low + (probe->high - probe->low) / 2) & ~3;
+    if (probe_alloc(size)) {
+        probe->low = size;
+    } else {
+        probe->high = size;
+    }
+    return false;
+}
+
+static void heap_fragmentation_analysis_start(void)
+{
+    if (frag_state != HEAP_FRAGMENTATION_IDLE || frag_paused) {
+        return;
+    }
+
+    frag_state = HEAP_FRAGMENTATION_NS_HEAP;
+    if (!heap_fragmentation_ns_init()) {
+        frag_state = HEAP_FRAGMENTATION_MBED_HEAP;
+        if (!heap_fragmentation_mbed_init()) {
+            frag_state = HEAP_FRAGMENTATION_IDLE;
+            return;
+        }
+    }
+    heap_fragmentation_step();
+}
+
+static void heap_fragmentation_step(void)
+{
+    if (frag_state == HEAP_FRAGMENTATION_NS_HEAP) {
+        if (heap_fragmentation_probe_step(&ns_probe, heap_fragmentation_ns_probe)) {
+            tr_info("NS heap free: %" PRIu32 " largest free block: %" PRIu32 " fragmentation: %" PRIu8 "%%",
+                    ns_probe.stats.free_bytes, ns_probe.stats.largest_free_block, ns_probe.stats.fragmentation);
+            frag_state = heap_fragmentation_mbed_init() ? HEAP_FRAGMENTATION_MBED_HEAP : HEAP_FRAGMENTATION_IDLE;
+        }
+    } else if (frag_state == HEAP_FRAGMENTATION_MBED_HEAP) {
+#ifdef HEAP_FRAGMENTATION_MBED_MALLOC
+        if (heap_fragmentation_probe_step(&mbed_probe, heap_fragmentation_mbed_probe)) {
+            tr_info("MBED heap free: %" PRIu32 " largest free block: %s%" PRIu32 " fragmentation: %" PRIu8 "%%",
+                    mbed_probe.stats.free_bytes, mbed_probe.stats.lower_bound ? ">=" : "",
+                    mbed_probe.stats.largest_free_block, mbed_probe.stats.fragmentation);
+            frag_state = HEAP_FRAGMENTATION_IDLE;
+        }
+#endif
+    }
+
+    if (frag_state == HEAP_FRAGMENTATION_IDLE) {
+        if (frag_done_cb) {
+            frag_done_cb();
+        }
+        return;
+    }
+
+    app_event_call_in(frag_queue, &heap_fragmentation_step_site, HEAP_FRAGMENTATION_STEP_INTERVAL);
+}
+
+int heap_fragmentation_start(events::EventQueue *queue, uint32_t interval, heap_fragmentation_done_cb *done_cb)
+{
+    if (!queue) {
+        return -1;
+    }
+
+    frag_queue = queue;
+    frag_done_cb = done_cb;
+    if (app_event_call_every(frag_queue, &heap_fragmentation_start_site, interval) == 0) {
+        tr_error("Heap fragmentation analysis cannot be scheduled");
+        return -1;
+    }
+    return 0;
+}
+
+void heap_fragmentation_pause(bool pause)
+{
+    frag_paused = pause;
+}
+
+void heap_fragmentation_ns_stats_get(heap_fragmentation_stats_t *stats)
+{
+    *stats = ns_probe.stats;
+}
+
+void heap_fragmentation_mbed_stats_get(heap_fragmentation_stats_t *stats)
+{
+    *stats = mbed_probe.stats;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HEAP_FRAGMENTATION_H
+#define HEAP_FRAGMENTATION_H
+
+typedef struct heap_fragmentation_stats {
+    uint32_t free_bytes;
+    uint32_t largest_free_block;    // Largest block that could be allocated, within probe granularity
+    uint8_t fragmentation;          // Percent, 100 * (1 - largest free block / free bytes)
+    bool lower_bound;               // Probing was capped, largest free block is at least this
+    bool valid;                     // Heap has been analyzed
+} heap_fragmentation_stats_t;
+
+typedef void heap_fragmentation_done_cb(void);
+
+/*
+ * Analyzes the nanostack and mbed heaps every interval milliseconds. Largest free block is searched
+ * with one allocation probe per event, so the event queue is not stalled by the analysis. Callback
+ * is called from the event queue when both heaps have been analyzed.
+ */
+int heap_fragmentation_start(events::EventQueue *queue, uint32_t interval, heap_fragmentation_done_cb *done_cb);
+/* Skips the periodic analyses while paused, analysis in progress is completed */
+void heap_fragmentation_pause(bool pause);
+void heap_fragmentation_ns_stats_get(heap_fragmentation_stats_t *stats);
+void heap_fragmentation_mbed_stats_get(heap_fragmentation_stats_t *stats);
+
+#endif /* HEAP_FRAGMENTATION_H */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef MBED_CONF_APP_HEAP_REGIONS
+
+#include "mbed.h"
+#include "nsdynmemLIB.h"
+#include "mbed-trace/mbed_trace.h"
+#include "nanostack_dynmempool.h"
+#include "heap_region_planner.h"
+
+#define TRACE_GROUP "aHeR"  //Application Heap Regions
+
+// Smaller pieces left over from the linker placed data are not worth a heap region
+#define HEAP_REGION_MIN_SIZE                1024
+
+static const heap_region_t heap_regions[] = MBED_CONF_APP_HEAP_REGIONS;
+#define HEAP_REGION_COUNT                   (sizeof(heap_regions) / sizeof(heap_regions[0]))
+
+typedef struct heap_region_range {
+    uint32_t start;
+    uint32_t end;
+} heap_region_range_t;
+
+#if defined(__GNUC__) && !defined(__ARMCC_VERSION)
+// Symbols of the GCC_ARM linker scripts, only the main RAM sections are known for every target
+extern uint32_t __data_start__;
+extern uint32_t __HeapLimit;
+extern uint32_t __StackLimit;
+extern uint32_t __StackTop;
+#define HEAP_REGION_EXCLUDED_COUNT          2
+#else
+#define HEAP_REGION_EXCLUDED_COUNT          0
+#endif
+
+static heap_region_range_t heap_region_excluded[HEAP_REGION_EXCLUDED_COUNT + 1];
+
+static void heap_region_planner_excluded_init(void)
+{
+#if HEAP_REGION_EXCLUDED_COUNT > 0
+    // Static data and bss and mbed heap, and main stack. Other target specific RAM sections are not excluded
+    heap_region_excluded[0].start = (uint32_t)(uintptr_t)&__data_start__;
+    heap_region_excluded[0].end = (uint32_t)(uintptr_t)&__HeapLimit;
+    heap_region_excluded[1].start = (uint32_t)(uintptr_t)&__StackLimit;
+    heap_region_excluded[1].end = (uint32_t)(uintptr_t)&__StackTop;
+#else
+    tr_warn("Heap regions are not checked against linker placement on this toolchain");
+#endif
+}
+
+static bool heap_region_planner_overlaps(uint32_t start, uint32_t end)
+{
+    for (uint8_t index = 0; index < HEAP_REGION_EXCLUDED_COUNT; index++) {
+        if (heap_region_excluded[index].end > start && heap_region_excluded[index].start < end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Adds the range to nanostack heap around the excluded ranges from exclude_index on */
+static uint32_t heap_region_planner_add(uint32_t start, uint32_t end, uint8_t exclude_index)
+{
+    for (; exclude_index < HEAP_REGION_EXCLUDED_COUNT; exclude_index++) {
+        const heap_region_range_t *excluded = &heap_region_excluded[exclude_index];
+        if (excluded->end <= start || excluded->start >= end) {
+            continue;
+        }
+        uint32_t added = 0;
+        if (excluded->start > start) {
+            added += heap_region_planner_add(start, excluded->start, exclude_index + 1);
+        }
+        if (excluded->end < end) {
+            added += heap_region_planner_add(excluded->end, end, exclude_index + 1);
+        }
+        return added;
+    }
+
+    if (end - start < HEAP_REGION_MIN_SIZE) {
+        tr_info("  0x%08" PRIx32 "-0x%08" PRIx32 " %" PRIu32 " bytes skipped, too small", start, end - 1, end - start);
+        return 0;
+    }
+    if (ns_dyn_mem_region_add((void *)(uintptr_t)start, (ns_mem_heap_size_t)(end - start)) != 0) {
+        tr_error("  0x%08" PRIx32 "-0x%08" PRIx32 " could not be added to nanostack heap", start, end - 1);
+        return 0;
+    }
+    tr_info("  0x%08" PRIx32 "-0x%08" PRIx32 " %" PRIu32 " bytes added to nanostack heap", start, end - 1, end - start);
+    return end - start;
+}
+
+uint32_t heap_region_planner_run(void)
+{
+    uint8_t order[HEAP_REGION_COUNT];
+    uint32_t added = 0;
+
+    heap_region_planner_excluded_init();
+
+    // Fastest regions first, insertion sort keeps the configured order within a rank
+    for (uint8_t index = 0; index < HEAP_REGION_COUNT; index++) {
+        uint8_t position = index;
+        while (position > 0 && heap_regions[order[position - 1]].rank > heap_regions[index].rank) {
+            order[position] = order[position - 1];
+            position--;
+        }
+        order[position] = index;
+    }
+
+    tr_info("Heap region plan:");
+    for (uint8_t index = 0; index < HEAP_REGION_COUNT; index++) {
+        const heap_region_t *region = &heap_regions[order[index]];
+        uint32_t start = region->start;
+        uint32_t end = region->start + region->size;
+
+        tr_info("Region 0x%08" PRIx32 "-0x%08" PRIx32 " rank %" PRIu8, start, end - 1, region->rank);
+#if defined(MBED_CONF_APP_HEAP_REGION_POOL_SIZE) && defined(MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SIZE_CLASSES)
+        // Size class pools are the most frequently used nanostack memory
+        if (index == 0 && region->size >= MBED_CONF_APP_HEAP_REGION_POOL_SIZE) {
+            if (heap_region_planner_overlaps(start, start + MBED_CONF_APP_HEAP_REGION_POOL_SIZE)) {
+                tr_warn("  pool region overlaps linker placed memory, not reserved");
+            } else if (ns_dyn_mem_pool_region_set((void *)(uintptr_t)start, MBED_CONF_APP_HEAP_REGION_POOL_SIZE) == 0) {
+                tr_info("  0x%08" PRIx32 "-0x%08" PRIx32 " %" PRIu32 " bytes reserved for size class pools",
+                        start, start + MBED_CONF_APP_HEAP_REGION_POOL_SIZE - 1, (uint32_t)MBED_CONF_APP_HEAP_REGION_POOL_SIZE);
+                start += MBED_CONF_APP_HEAP_REGION_POOL_SIZE;
+            }
+        }
+#endif
+        if (heap_region_planner_overlaps(start, end)) {
+            tr_info("  overlaps linker placed memory, only free parts are used");
+        }
+        added += heap_region_planner_add(start, end, 0);
+    }
+
+    const mem_stat_t *stat = ns_dyn_mem_get_mem_stat();
+    tr_info("Nanostack heap %" PRIu32 " bytes, %" PRIu32 " bytes from heap regions",
+            stat ? (uint32_t)stat->heap_sector_size : 0, added);
+
+    return added;
+}
+
+#endif
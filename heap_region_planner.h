@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HEAP_REGION_PLANNER_H
+#define HEAP_REGION_PLANNER_H
+
+/*
+ * Memory region given to the planner with heap-regions configuration. Rank orders the regions by speed,
+ * 0 is the fastest memory, e.g. DTCM before internal SRAM before external SDRAM.
+ */
+typedef struct heap_region {
+    uint32_t start;
+    uint32_t size;
+    uint8_t rank;
+} heap_region_t;
+
+/*
+ * Adds the configured regions to the nanostack heap, fastest first, after removing the parts used by
+ * the linker placed data, mbed heap and stack. Part of the fastest region is reserved for the nanostack
+ * size class pools when heap-region-pool-size is set. Traces the resulting layout.
+ * Nanostack heap must be initialized. Returns number of bytes added to nanostack heap.
+ */
+uint32_t heap_region_planner_run(void);
+
+#endif /* HEAP_REGION_PLANNER_H */
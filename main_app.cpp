@@ -25,6 +25,13 @@
 #include "WisunBorderRouter.h"
 #include "MeshInterfaceNanostack.h"
 #include "network_dns_optimization.h"
+#include "network_dns_proxy.h"
+#include "network_backhaul.h"
+#include "boot_timeline.h"
+#include "heap_fragmentation.h"
+#include "memory_pressure.h"
+#include "heap_region_planner.h"
+#include "app_event_queues.h"
 #include "cloud_client_helper.h"
 #include "kvstore_global_api.h"
 #if defined MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER && (MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER == 1)
@@ -48,17 +55,6 @@
 
 #define TRACE_GROUP "App "
 
-#ifndef DNS_QUERY_SET_PERIOD
-#define DNS_QUERY_SET_PERIOD 12*60*60*1000     // 12 Hours
-#endif
-
-#ifndef BACKHAUL_CONNECTION_RETRY_TIMEOUT
-#define BACKHAUL_CONNECTION_RETRY_TIMEOUT 1000
-#endif
-#ifndef BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX
-#define BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX 300*1000
-#endif
-
 #ifndef MESH_IFACE_START_MAX_WAIT
 #ifdef MBED_CONF_APP_MESH_IFACE_START_TIMEOUT
 #define MESH_IFACE_START_MAX_WAIT (MBED_CONF_APP_MESH_IFACE_START_TIMEOUT*1000)
@@ -67,8 +63,20 @@
 #endif
 #endif
 
+#ifdef MBED_CONF_APP_WISUN_NETWORK_DNS_STATS_INTERVAL
+#define DNS_OPT_STATS_INTERVAL MBED_CONF_APP_WISUN_NETWORK_DNS_STATS_INTERVAL
+#else
+#define DNS_OPT_STATS_INTERVAL 60*1000         // 1 Minute
+#endif
+
 #define MESH_IFACE_CTRL_VAL_MAX_SIZE        16
 #define APP_STATE_VAL_MAX_SIZE              32
+#define DNS_OPT_NAMES_VAL_MAX_SIZE          256
+#define DNS_OPT_STATS_VAL_MAX_SIZE          96
+#define MEM_TRACKER_LEAK_VAL_MAX_SIZE       128
+#define DNS_OPT_AGES_VAL_MAX_SIZE           512
+#define EVENT_SITES_VAL_MAX_SIZE            1024
+#define BOOT_TIMELINE_VAL_MAX_SIZE          160
 #define MESH_IFACE_CTRL_CONTINUE            "CONTINUE"
 #define MESH_IFACE_CTRL_BLOCK               "BLOCK"
 #define APP_STATE_WAIT_PERMISSION           "Waiting Permission"
@@ -91,6 +99,41 @@ static M2MResource *m2m_deregister_res;
 static M2MResource *m2m_factory_reset_res;
 static M2MResource *mesh_iface_control;
 static M2MResource *app_state;
+static M2MResource *time_to_backhaul;
+static M2MResource *backhaul_outage;
+static M2MResource *boot_timeline;
+static char boot_timeline_value[BOOT_TIMELINE_VAL_MAX_SIZE];
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+static M2MResource *dns_opt_names;
+static M2MResource *dns_opt_resolutions;
+static M2MResource *dns_opt_failures;
+static M2MResource *dns_opt_publishes;
+static M2MResource *dns_opt_publish_failures;
+static M2MResource *dns_opt_latency;
+static M2MResource *dns_opt_answer_ages;
+#endif
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL
+static M2MResource *memory_pressure_level;
+#endif
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+static M2MResource *ns_heap_largest_free;
+static M2MResource *ns_heap_fragmentation;
+static M2MResource *mbed_heap_largest_free;
+static M2MResource *mbed_heap_fragmentation;
+#endif
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
+static M2MResource *mem_tracker_snapshot;
+static uint8_t mem_tracker_snapshot_value[NS_DYN_MEM_TRACKER_SNAPSHOT_MAX_SIZE];
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+static M2MResource *mem_tracker_leak;
+static char mem_tracker_leak_value[MEM_TRACKER_LEAK_VAL_MAX_SIZE] = {0, };
+#endif
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+static M2MResource *event_sites;
+static char event_sites_value[EVENT_SITES_VAL_MAX_SIZE];
+#endif
 
 static void mesh_connect(void);
 static void check_mesh_iface_control(void);
@@ -98,6 +141,13 @@ static char app_mesh_control_kv_key[] = "/kv/mesh_iface_ctrl_key";
 static char mesh_iface_control_value[MESH_IFACE_CTRL_VAL_MAX_SIZE] = {0, };
 static char app_state_value[APP_STATE_VAL_MAX_SIZE] = {0, };
 static bool mesh_interface_up = false;
+static volatile bool mesh_iface_start_released = false;
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+static char app_dns_opt_names_kv_key[] = "/kv/dns_opt_names_key";
+static char dns_opt_names_value[DNS_OPT_NAMES_VAL_MAX_SIZE] = {0, };
+static char dns_opt_latency_value[DNS_OPT_STATS_VAL_MAX_SIZE] = {0, };
+static char dns_opt_answer_ages_value[DNS_OPT_AGES_VAL_MAX_SIZE] = {0, };
+#endif
 rtos::Semaphore mesh_control_data_found;
 
 static EventQueue *queue;
@@ -113,8 +163,10 @@ static EventQueue *keep_alive_queue;
 #endif
 static EventQueue *mem_stats_queue;
 extern mem_stat_t app_ns_dyn_mem_stats;
+static bool mem_stats_paused = false;
 #endif
 rtos::Semaphore mesh_global_ip;
+rtos::Semaphore backhaul_up;
 
 typedef enum app_status {
     APP_STATUS_FAIL = -1,
@@ -150,9 +202,15 @@ static void print_mbed_heap_stats(void)
 
 static void print_mem_stats(void)
 {
+    if (mem_stats_paused) {
+        return;
+    }
     print_ns_heap_stats();
     print_mbed_heap_stats();
+    app_event_queues_trace();
 }
+
+APP_EVENT_SITE(print_mem_stats_site, print_mem_stats);
 #endif
 
 static void print_client_ids(void)
@@ -171,6 +229,7 @@ static void deregister_client(void)
 
 static void client_registered(void)
 {
+    boot_timeline_mark(BOOT_TIMELINE_REGISTERED);
     printf("Client registered\n");
     print_client_ids();
 
@@ -179,16 +238,6 @@ static void client_registered(void)
     } else {
 #if defined MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER && (MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER == 1)
         ws_network_manager.nm_cloud_client_connect_indication();
-#endif
-
-#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
-        network_dns_opt_configure(&ws_border_router, backhaul_interface);
-        network_dns_opt_query_set();
-#if MBED_MAJOR_VERSION > 5
-        queue->call_every(std::chrono::milliseconds(DNS_QUERY_SET_PERIOD), network_dns_opt_query_set);
-#else
-        queue->call_every(DNS_QUERY_SET_PERIOD, network_dns_opt_query_set);
-#endif
 #endif
     }
 }
@@ -239,28 +288,35 @@ static void factory_reset(void *)
     tr_info("POST factory reset executed\n");
     m2m_factory_reset_res->send_delayed_post_response();
 
+    cloud_config_cache_clear();
     kcm_factory_reset();
 }
 
+/* Lets main() start the mesh interface, the control data, timeout and registration may all release it */
+static void mesh_iface_start_release(void)
+{
+    if (!core_util_atomic_exchange_bool(&mesh_iface_start_released, true)) {
+        mesh_control_data_found.release();
+    }
+}
+
 static void mesh_iface_start_max_wait_cb(void)
 {
-    mesh_control_data_found.release();
+    mesh_iface_start_release();
 }
 
+APP_EVENT_SITE(mesh_iface_start_max_wait_site, mesh_iface_start_max_wait_cb);
+
 static void check_mesh_iface_control(void)
 {
     // if the mesh_iface_control_value is not MESH_IFACE_CTRL_BLOCK, then release the mesh_control_data_found semaphore
     if (strncmp(mesh_iface_control_value, MESH_IFACE_CTRL_BLOCK, strlen(MESH_IFACE_CTRL_BLOCK))) {
-        mesh_control_data_found.release();
+        mesh_iface_start_release();
     } else {
         strcpy(app_state_value, APP_STATE_WAIT_PERMISSION);
         tr_warn("Waiting for mesh_iface_control_value to start the mesh interface");
         if (MESH_IFACE_START_MAX_WAIT != 0) {
-#if MBED_MAJOR_VERSION > 5
-            mesh_iface_control_queue->call_in(std::chrono::milliseconds(MESH_IFACE_START_MAX_WAIT), mesh_iface_start_max_wait_cb);
-#else
-            mesh_iface_control_queue->call_in(MESH_IFACE_START_MAX_WAIT, mesh_iface_start_max_wait_cb);
-#endif
+            app_event_call_in(mesh_iface_control_queue, &mesh_iface_start_max_wait_site, MESH_IFACE_START_MAX_WAIT);
         }
     }
 }
@@ -295,13 +351,172 @@ static void mesh_iface_control_cb(const char * /*object_name*/)
     if (!mesh_interface_up) {
         // if the received value is not MESH_IFACE_CTRL_BLOCK, then release the mesh_control_data_found semaphore
         if (strncmp(mesh_iface_control_value, MESH_IFACE_CTRL_BLOCK, strlen(MESH_IFACE_CTRL_BLOCK))) {
-            mesh_control_data_found.release();
+            mesh_iface_start_release();
         } else {
             tr_warn("Mesh interface is not started");
         }
     }
 }
 
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+static void dns_opt_names_apply(char *names)
+{
+    network_dns_opt_names_set(names);
+    free(names);
+}
+
+/* DNS optimization module runs in the event queue, the call owns a copy so a later PUT cannot change the list mid-parse */
+static void dns_opt_names_post(const char *names)
+{
+    char *copy = strdup(names);
+
+    if (copy == NULL) {
+        tr_error("No memory for DNS Optimization Names");
+        return;
+    }
+    if (queue->call(dns_opt_names_apply, copy) == 0) {
+        tr_error("DNS Optimization Names cannot be scheduled");
+        free(copy);
+    }
+}
+
+static void dns_opt_names_cb(const char * /*object_name*/)
+{
+    int kv_status;
+    String dns_opt_names_val = dns_opt_names->get_value_string();
+
+    if (dns_opt_names_val.c_str() == NULL) {
+        tr_error("Received DNS Optimization Names is NULL\n");
+        return;
+    }
+
+    strncpy(dns_opt_names_value, (char *)dns_opt_names_val.c_str(), DNS_OPT_NAMES_VAL_MAX_SIZE - 1);
+    dns_opt_names_value[DNS_OPT_NAMES_VAL_MAX_SIZE - 1] = '\0';
+
+    tr_info("Received DNS Optimization Names: %s", dns_opt_names_value);
+
+    tr_debug("Setting dns_opt_names_value in KVStore using key: %s\n", app_dns_opt_names_kv_key);
+    kv_status = kv_set(app_dns_opt_names_kv_key, dns_opt_names_value, strlen(dns_opt_names_value) + 1, 0);
+    if (kv_status != MBED_SUCCESS) {
+        tr_warn("Could not set DNS Optimization Names into KVStore, Error: %d", MBED_GET_ERROR_CODE(kv_status));
+    } else {
+        tr_info("DNS Optimization Names stored into KVStore");
+    }
+
+    dns_opt_names_post(dns_opt_names_value);
+}
+
+/* Copies DNS optimization statistics to the observable resources, runs in the event queue */
+static void dns_opt_stats_update(void)
+{
+    network_dns_opt_stats_t stats;
+    size_t length = 0;
+
+    network_dns_opt_stats_get(&stats);
+    dns_opt_resolutions->set_value(stats.resolutions);
+    dns_opt_failures->set_value(stats.failures);
+    dns_opt_publishes->set_value(stats.publishes);
+    dns_opt_publish_failures->set_value(stats.publish_failures);
+
+    for (int i = 0; i < NETWORK_DNS_OPT_LATENCY_BUCKETS; i++) {
+        length += snprintf(dns_opt_latency_value + length, sizeof(dns_opt_latency_value) - length, "%s%" PRIu32, i ? "," : "", stats.latency_histogram[i]);
+        if (length >= sizeof(dns_opt_latency_value)) {
+            break;
+        }
+    }
+    dns_opt_latency->set_value((const uint8_t *)dns_opt_latency_value, strlen(dns_opt_latency_value));
+
+    if (network_dns_opt_answer_ages_get(dns_opt_answer_ages_value, sizeof(dns_opt_answer_ages_value)) < 0) {
+        tr_warn("DNS optimization answer ages truncated");
+    }
+    dns_opt_answer_ages->set_value((const uint8_t *)dns_opt_answer_ages_value, strlen(dns_opt_answer_ages_value));
+}
+
+APP_EVENT_SITE(dns_opt_stats_update_site, dns_opt_stats_update);
+#endif
+
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL) && defined(MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD)
+static void mem_tracker_leak_publish(void)
+{
+    if (mem_tracker_leak) {
+        mem_tracker_leak->set_value((const uint8_t *)mem_tracker_leak_value, strlen(mem_tracker_leak_value));
+    }
+}
+
+/* Publishes the latest leak suspect of the memory tracker, runs in the diagnostics queue */
+static void mem_tracker_leak_cb(void *caller_addr, const char *function, uint16_t line, int32_t slope, uint32_t memory)
+{
+    snprintf(mem_tracker_leak_value, sizeof(mem_tracker_leak_value), "%p %s:%" PRIu16 " %" PRId32 " B/h %" PRIu32 " B",
+             caller_addr, function ? function : "", line, slope, memory);
+    // Resources are updated in the cloud client queue
+    queue->call(mem_tracker_leak_publish);
+}
+#endif
+
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+/* Copies heap fragmentation analysis results to the observable resources, runs in the event queue */
+static void heap_fragmentation_update(void)
+{
+    heap_fragmentation_stats_t stats;
+
+    heap_fragmentation_ns_stats_get(&stats);
+    if (stats.valid) {
+        ns_heap_largest_free->set_value(stats.largest_free_block);
+        ns_heap_fragmentation->set_value(stats.fragmentation);
+    }
+
+    heap_fragmentation_mbed_stats_get(&stats);
+    if (stats.valid) {
+        mbed_heap_largest_free->set_value(stats.largest_free_block);
+        mbed_heap_fragmentation->set_value(stats.fragmentation);
+    }
+}
+
+/* Analysis runs in the diagnostics queue */
+static void heap_fragmentation_done(void)
+{
+    queue->call(heap_fragmentation_update);
+}
+#endif
+
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL
+/* Sheds memory and deferrable work when heap headroom gets low, runs in the event queue */
+static void memory_pressure_action(memory_pressure_level_t level, memory_pressure_level_t previous_level)
+{
+    (void)previous_level;
+
+    if (memory_pressure_level) {
+        memory_pressure_level->set_value(level);
+    }
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) && (MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY == 1)
+    // Half of the cache when elevated, no cache from high level on
+    if (level == MEMORY_PRESSURE_NORMAL) {
+        network_dns_proxy_cache_limit_set(network_dns_proxy_cache_size());
+    } else {
+        network_dns_proxy_cache_limit_set(level == MEMORY_PRESSURE_ELEVATED ? network_dns_proxy_cache_size() / 2 : 0);
+    }
+#endif
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    network_dns_opt_refresh_postpone(level >= MEMORY_PRESSURE_HIGH);
+#endif
+
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+    // Probes would compete for the remaining memory
+    heap_fragmentation_pause(level >= MEMORY_PRESSURE_ELEVATED);
+#endif
+
+    // Statistics dumps are paused from high level on, the pressure level resource still tells the state
+#if defined MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE && (MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE == 1)
+    mem_stats_paused = level >= MEMORY_PRESSURE_HIGH;
+#endif
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
+    ns_dyn_mem_tracker_trace_pause(level >= MEMORY_PRESSURE_HIGH);
+#endif
+}
+#endif
+
 static coap_response_code_e app_res_read_cb(const M2MResourceBase &resource,
                                             uint8_t *&buffer,
                                             size_t &buffer_size,
@@ -324,6 +539,38 @@ static coap_response_code_e app_res_read_cb(const M2MResourceBase &resource,
         tr_debug("Setting app_state_value to Client: %s", app_state_value);
     }
 
+    if (obj == boot_timeline) {
+        buffer = (uint8_t *)boot_timeline_value;
+        buffer_size = boot_timeline_get(boot_timeline_value, sizeof(boot_timeline_value));
+        tr_debug("Setting boot timeline to Client: %s", boot_timeline_value);
+    }
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    if (obj == dns_opt_names) {
+        buffer = (uint8_t *)dns_opt_names_value;
+        buffer_size = strlen(dns_opt_names_value);
+        tr_debug("Setting dns_opt_names_value to Client: %s", dns_opt_names_value);
+    }
+#endif
+
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
+    if (obj == mem_tracker_snapshot) {
+        // Allocator lists are updated once per tracker print interval
+        int length = ns_dyn_mem_tracker_snapshot_get(mem_tracker_snapshot_value, sizeof(mem_tracker_snapshot_value));
+        buffer = mem_tracker_snapshot_value;
+        buffer_size = (length < 0) ? 0 : length;
+        tr_debug("Setting memory tracker snapshot to Client: %d bytes", length);
+    }
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    if (obj == event_sites) {
+        buffer = (uint8_t *)event_sites_value;
+        buffer_size = app_event_sites_summary_get(event_sites_value, sizeof(event_sites_value));
+        tr_debug("Setting event call site summary to Client: %u bytes", (unsigned int)buffer_size);
+    }
+#endif
+
     return COAP_RESPONSE_CONTENT;
 }
 
@@ -341,6 +588,81 @@ static app_status_t PDMC_create_resource(void)
     app_state = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 14, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
     app_state->set_read_resource_function(app_res_read_cb, app_state);
 
+    // Observable GET resources 33455/0/30-31, updated when the backhaul connects
+    network_backhaul_stats_t backhaul_stats;
+    network_backhaul_stats_get(&backhaul_stats);
+    time_to_backhaul = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 30, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    backhaul_outage = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 31, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    time_to_backhaul->set_value(backhaul_stats.time_to_backhaul);
+    backhaul_outage->set_value(backhaul_stats.last_outage);
+    time_to_backhaul->set_observable(true);
+    backhaul_outage->set_observable(true);
+
+    // GET resource 33455/0/32, milliseconds from boot to the completion of the boot phases
+    boot_timeline = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 32, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
+    boot_timeline->set_read_resource_function(app_res_read_cb, boot_timeline);
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    // PUT/GET resource 33455/0/15
+    dns_opt_names = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 15, M2MResourceInstance::STRING, M2MBase::GET_PUT_ALLOWED);
+    if (dns_opt_names->set_value_updated_function(dns_opt_names_cb) != true) {
+        tr_error("dns_opt_names->set_value_updated_function() failed");
+        return APP_STATUS_FAIL;
+    }
+    dns_opt_names->set_read_resource_function(app_res_read_cb, dns_opt_names);
+
+    // Observable GET resources 33455/0/16-21, updated every DNS_OPT_STATS_INTERVAL
+    dns_opt_resolutions = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 16, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    dns_opt_failures = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 17, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    dns_opt_publishes = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 18, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    dns_opt_publish_failures = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 19, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    dns_opt_latency = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 20, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
+    dns_opt_answer_ages = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 21, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
+    dns_opt_resolutions->set_observable(true);
+    dns_opt_failures->set_observable(true);
+    dns_opt_publishes->set_observable(true);
+    dns_opt_publish_failures->set_observable(true);
+    dns_opt_latency->set_observable(true);
+    dns_opt_answer_ages->set_observable(true);
+#endif
+
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL
+    // Observable GET resource 33455/0/28, 0 normal, 1 elevated, 2 high, 3 critical
+    memory_pressure_level = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 28, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    memory_pressure_level->set_value(memory_pressure_level_get());
+    memory_pressure_level->set_observable(true);
+#endif
+
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+    // Observable GET resources 33455/0/24-27, updated when heap fragmentation analysis completes
+    ns_heap_largest_free = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 24, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    ns_heap_fragmentation = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 25, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    mbed_heap_largest_free = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 26, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    mbed_heap_fragmentation = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 27, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED);
+    ns_heap_largest_free->set_observable(true);
+    ns_heap_fragmentation->set_observable(true);
+    mbed_heap_largest_free->set_observable(true);
+    mbed_heap_fragmentation->set_observable(true);
+#endif
+
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
+    // GET resource 33455/0/22, binary snapshot of the memory tracker allocator lists
+    mem_tracker_snapshot = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 22, M2MResourceInstance::OPAQUE, M2MBase::GET_ALLOWED);
+    mem_tracker_snapshot->set_read_resource_function(app_res_read_cb, mem_tracker_snapshot);
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+    // Observable GET resource 33455/0/23, latest caller whose retained memory grows faster than the threshold
+    mem_tracker_leak = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 23, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
+    mem_tracker_leak->set_value((const uint8_t *)mem_tracker_leak_value, strlen(mem_tracker_leak_value));
+    mem_tracker_leak->set_observable(true);
+#endif
+#endif
+
+#ifdef MBED_CONF_APP_EVENT_INSTRUMENTATION_INTERVAL
+    // GET resource 33455/0/29, lateness and runtime of the event callbacks per call site
+    event_sites = M2MInterfaceFactory::create_resource(m2m_obj_list, 33455, 0, 29, M2MResourceInstance::STRING, M2MBase::GET_ALLOWED);
+    event_sites->set_read_resource_function(app_res_read_cb, event_sites);
+#endif
+
     // GET resource 3200/0/5501
     // PUT also allowed for resetting the resource
     m2m_get_res = M2MInterfaceFactory::create_resource(m2m_obj_list, 3200, 0, 5501, M2MResourceInstance::INTEGER, M2MBase::GET_PUT_ALLOWED);
@@ -431,6 +753,7 @@ static app_status_t PDMC_init(void)
 #endif
 #endif
     }
+    boot_timeline_mark(BOOT_TIMELINE_CONFIG_VERIFIED);
 #endif
 
 #ifdef MBED_CLOUD_CLIENT_SUPPORT_UPDATE
@@ -438,6 +761,7 @@ static app_status_t PDMC_init(void)
 #else
     cloud_client = new MbedCloudClient(client_registered, client_unregistered, client_error);
 #endif // MBED_CLOUD_CLIENT_SUPPORT_UPDATE
+    boot_timeline_mark(BOOT_TIMELINE_CLOUD_INIT);
     return APP_STATUS_SUCCESS;
 }
 
@@ -471,6 +795,12 @@ static void mesh_interface_status_callback(nsapi_event_t status, intptr_t param)
                     break;
                 }
                 tr_info("Mesh Interface connected with IP %s", sa.get_ip_address());
+                if (!mesh_interface_up) {
+                    boot_timeline_mark(BOOT_TIMELINE_WISUN_ACTIVE);
+                    tr_info("Wi-SUN Active in %" PRIu32 " ms from boot, %" PRIu32 " ms from mesh start",
+                            boot_timeline_time_get(BOOT_TIMELINE_WISUN_ACTIVE),
+                            boot_timeline_time_get(BOOT_TIMELINE_WISUN_ACTIVE) - boot_timeline_time_get(BOOT_TIMELINE_MESH_START));
+                }
                 mesh_interface_up = true;
                 strcpy(app_state_value, APP_STATE_WISUN_ACTIVE);
                 mesh_global_ip.release();
@@ -492,6 +822,16 @@ static void mesh_interface_status_callback(nsapi_event_t status, intptr_t param)
     }
 }
 
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+static void dns_opt_start(void)
+{
+    network_dns_opt_configure(&ws_border_router, backhaul_interface);
+    network_dns_opt_query_set();
+}
+
+APP_EVENT_SITE(dns_opt_start_site, dns_opt_start);
+#endif
+
 static void mesh_connect(void)
 {
     int status;
@@ -499,6 +839,7 @@ static void mesh_connect(void)
 
     // Updating App state as APP_STATE_WISUN_BOOTING
     strcpy(app_state_value, APP_STATE_WISUN_BOOTING);
+    boot_timeline_mark(BOOT_TIMELINE_MESH_START);
 
     mesh_interface->add_event_listener(mbed::callback(&mesh_interface_status_callback));
     status = mesh_interface->connect();
@@ -508,6 +849,13 @@ static void mesh_connect(void)
                 printf("FAILED to start Border Router\n");
                 return;
             }
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+            // Publishes the answers resolved since the backhaul connection was established
+            queue->call(network_dns_opt_mesh_started);
+#endif
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) && (MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY == 1)
+            queue->call(network_dns_proxy_start, (void *)mesh_interface, (void *)backhaul_interface);
+#endif
         } else {
             tr_warn("Backhaul Interface is not yet started");
         }
@@ -517,49 +865,22 @@ static void mesh_connect(void)
     return;
 }
 
-static app_status_t backhaul_connect(void)
+/* Publishes the backhaul connection times and lets the boot continue, runs in the event queue */
+static void backhaul_connected_cb(void)
 {
-    int status;
-    SocketAddress sa;
-    int retry_count = 0;
-    int next_retry_interval;
-    bool backhaul_connected = false;
-
-    if (backhaul_interface == NULL) {
-        tr_warn("Backhaul Interface is not Initialized yet");
-        return APP_STATUS_FAIL;
+    static bool backhaul_up_released = false;
+    network_backhaul_stats_t stats;
+
+    network_backhaul_stats_get(&stats);
+    boot_timeline_mark(BOOT_TIMELINE_BACKHAUL_UP);
+    if (time_to_backhaul) {
+        time_to_backhaul->set_value(stats.time_to_backhaul);
+        backhaul_outage->set_value(stats.last_outage);
     }
-
-    while (!backhaul_connected) {
-        retry_count++;
-        status = backhaul_interface->connect();
-        tr_info("Backhaul MAC Address: %s", backhaul_interface->get_mac_address() ? backhaul_interface->get_mac_address() : "None");
-        if (status == NSAPI_ERROR_OK || status == NSAPI_ERROR_IS_CONNECTED) {
-            status = backhaul_interface->get_ip_address(&sa);
-            if (status != NSAPI_ERROR_OK) {
-                tr_debug("Backhaul get_ip_address() - failed, status %d", status);
-                goto retry;
-            } else {
-                backhaul_connected = true;
-                continue;
-            }
-        }
-        tr_warn("Failed to connect! error=%d. Retry %d", status, retry_count);
-retry:
-        (void) backhaul_interface->disconnect();
-        next_retry_interval = BACKHAUL_CONNECTION_RETRY_TIMEOUT * retry_count;
-        if (next_retry_interval > BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX) {
-            next_retry_interval = BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX;
-        }
-#if MBED_MAJOR_VERSION > 5
-        ThisThread::sleep_for(std::chrono::milliseconds(next_retry_interval));
-#else
-        ThisThread::sleep_for(next_retry_interval);
-#endif
+    if (!backhaul_up_released) {
+        backhaul_up_released = true;
+        backhaul_up.release();
     }
-
-    tr_info("Backhaul Interface connected with IP %s", sa.get_ip_address() ? sa.get_ip_address() : "None");
-    return APP_STATUS_SUCCESS;
 }
 
 #ifndef MBED_TEST_MODE
@@ -567,24 +888,25 @@ int main(void)
 {
     int status;
 
-    queue = mbed_event_queue();
-    mesh_iface_control_queue = mbed_event_queue();
+    // Diagnostics run in a low priority queue, so they do not delay cloud client and mesh control
+    app_event_queues_init();
+    queue = app_event_queue_get(APP_EVENT_QUEUE_DEFAULT);
+    mesh_iface_control_queue = app_event_queue_get(APP_EVENT_QUEUE_CONTROL);
 
 #if defined MBED_CONF_APP_ACTIVE_KEEP_ALIVE && (MBED_CONF_APP_ACTIVE_KEEP_ALIVE == 1)
-    keep_alive_queue = mbed_event_queue();
+    keep_alive_queue = app_event_queue_get(APP_EVENT_QUEUE_DEFAULT);
 #endif
 
 #if defined MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE && (MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE == 1)
-    mem_stats_queue = mbed_event_queue();
-#if MBED_MAJOR_VERSION > 5
-    mem_stats_queue->call_every(std::chrono::milliseconds(MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE_INTERVAL), print_mem_stats);
-#else
-    mem_stats_queue->call_every(MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE_INTERVAL, print_mem_stats);
-#endif
+    mem_stats_queue = app_event_queue_get(APP_EVENT_QUEUE_DIAG);
+    app_event_call_every(mem_stats_queue, &print_mem_stats_site, MBED_CONF_APP_MEM_STATS_PERIODIC_TRACE_INTERVAL);
 #endif
 
 #ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
-    ns_dyn_mem_tracker_init();
+    ns_dyn_mem_tracker_init(app_event_queue_get(APP_EVENT_QUEUE_DIAG));
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+    ns_dyn_mem_tracker_leak_callback_set(mem_tracker_leak_cb);
+#endif
 #endif
 
     status = mbed_trace_init();
@@ -606,6 +928,7 @@ int main(void)
         tr_err("kv_init_storage_config() - failed, status %d", status);
         return -1;
     }
+    boot_timeline_mark(BOOT_TIMELINE_KV_INIT);
 
     // Backhaul Interface
     tr_info("Fetching Backhaul Interface");
@@ -623,6 +946,12 @@ int main(void)
         return -1;
     }
 
+#ifdef MBED_CONF_APP_HEAP_REGIONS
+    // Nanostack heap is created when the mesh interface is constructed, add the free RAM regions to it
+    mesh_system_init();
+    heap_region_planner_run();
+#endif
+
 #if defined MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER && (MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER == 1)
     if (ws_network_manager.configure_factory_mac_address(mesh_interface, backhaul_interface) != NM_ERROR_NONE) {
         tr_err("Failed to configure Factory MAC addresses on Interfaces");
@@ -630,8 +959,9 @@ int main(void)
     }
 #endif
 
+    // Backhaul connects in the event queue while the cloud client is initialized
     tr_info("Connect to Backhaul Interaface");
-    if (backhaul_connect() == APP_STATUS_FAIL) {
+    if (network_backhaul_start(queue, backhaul_interface, backhaul_connected_cb) != 0) {
         tr_err("Failed to connect Backhaul Interface");
         return -1;
     }
@@ -641,6 +971,13 @@ int main(void)
         return -1;
     }
 
+    backhaul_up.acquire();
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    // Server URIs are available in KCM after PDMC_init(), resolve them while registering to Pelion
+    app_event_call(queue, &dns_opt_start_site);
+#endif
+
 #if defined MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER && (MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER == 1)
     tr_info("Configuring Interfaces");
     if (ws_network_manager.reg_and_config_iface(mesh_interface, backhaul_interface, &ws_border_router) != NM_ERROR_NONE) {
@@ -659,17 +996,49 @@ int main(void)
     }
 #endif
 
+#if !defined(MBED_CONF_APP_MESH_IFACE_START_AFTER_REGISTRATION) || (MBED_CONF_APP_MESH_IFACE_START_AFTER_REGISTRATION == 0)
+    // Mesh formation needs the backhaul but not the registration, unless blocked by the mesh interface control
+    if (strncmp(mesh_iface_control_value, MESH_IFACE_CTRL_BLOCK, strlen(MESH_IFACE_CTRL_BLOCK))) {
+        tr_info("Mesh interface is started without waiting for the registration");
+        mesh_iface_start_release();
+    }
+#endif
+
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    // Read additional DNS optimization names set through the resource
+    size_t dns_opt_names_size = 0;
+    if (kv_get(app_dns_opt_names_kv_key, dns_opt_names_value, DNS_OPT_NAMES_VAL_MAX_SIZE - 1, &dns_opt_names_size) == MBED_SUCCESS) {
+        dns_opt_names_value[dns_opt_names_size] = '\0';
+        dns_opt_names_post(dns_opt_names_value);
+    }
+#endif
+
     if (PDMC_create_resource() == APP_STATUS_FAIL) {
         tr_err("Failed to Create Resources: Terminating Application");
         return -1;
     }
 
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+    queue->call(dns_opt_stats_update);
+    app_event_call_every(queue, &dns_opt_stats_update_site, DNS_OPT_STATS_INTERVAL);
+#endif
+
+#ifdef MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL
+    heap_fragmentation_start(app_event_queue_get(APP_EVENT_QUEUE_DIAG), MBED_CONF_APP_HEAP_FRAGMENTATION_INTERVAL, heap_fragmentation_done);
+#endif
+
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL
+    memory_pressure_action_register(memory_pressure_action);
+    memory_pressure_start(queue, MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL);
+#endif
+
 #if defined MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER && (MBED_CONF_MBED_CLOUD_CLIENT_NETWORK_MANAGER == 1)
     ws_network_manager.create_resource(&m2m_obj_list);
 #endif
 
     cloud_client->add_objects(m2m_obj_list);
     cloud_client->setup(backhaul_interface);
+    boot_timeline_mark(BOOT_TIMELINE_CLOUD_SETUP);
 
     mesh_control_data_found.acquire();
     mesh_connect();
@@ -677,6 +1046,7 @@ int main(void)
 
 #ifdef MBED_CLOUD_CLIENT_SUPPORT_MULTICAST_UPDATE
     arm_uc_multicast_interface_configure(get_mesh_iface_id());
+    boot_timeline_mark(BOOT_TIMELINE_MULTICAST);
 #endif
 
     cloud_client->setup(backhaul_interface, true);
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_INTERVAL
+
+#include "mbed.h"
+#include "nsdynmemLIB.h"
+#include "mbed-trace/mbed_trace.h"
+#include "memory_pressure.h"
+#include "app_event_queues.h"
+
+#define TRACE_GROUP "aMeP"  //Application Memory Pressure
+
+// Free heap percentages below which elevated, high and critical levels are entered
+#ifdef MBED_CONF_APP_MEMORY_PRESSURE_WATERMARKS
+static const uint8_t pressure_watermarks[] = MBED_CONF_APP_MEMORY_PRESSURE_WATERMARKS;
+#else
+static const uint8_t pressure_watermarks[] = {25, 15, 5};
+#endif
+#define MEMORY_PRESSURE_LEVELS              (sizeof(pressure_watermarks) / sizeof(pressure_watermarks[0]) + 1)
+
+// Level is left when free heap is this many percents above its watermark
+#define MEMORY_PRESSURE_HYSTERESIS          5
+#define MEMORY_PRESSURE_ACTIONS_MAX         8
+
+static const char *const pressure_level_names[] = {"normal", "elevated", "high", "critical"};
+
+static memory_pressure_level_t pressure_level = MEMORY_PRESSURE_NORMAL;
+static memory_pressure_action_cb *pressure_actions[MEMORY_PRESSURE_ACTIONS_MAX];
+static uint32_t pressure_ns_alloc_fail_cnt = 0;
+
+/* Level of the free percentage, watermarks are raised by the hysteresis when leaving the current level */
+static memory_pressure_level_t memory_pressure_level_of(uint8_t free_percent)
+{
+    uint8_t level = MEMORY_PRESSURE_NORMAL;
+
+    for (uint8_t index = 0; index < MEMORY_PRESSURE_LEVELS - 1; index++) {
+        uint8_t watermark = pressure_watermarks[index];
+        if (index < pressure_level) {
+            watermark += MEMORY_PRESSURE_HYSTERESIS;
+        }
+        if (free_percent < watermark) {
+            level = index + 1;
+        }
+    }
+    return (memory_pressure_level_t)level;
+}
+
+static void memory_pressure_sample(void)
+{
+    memory_pressure_level_t level = MEMORY_PRESSURE_NORMAL;
+    uint8_t ns_free_percent = 100;
+    uint8_t mbed_free_percent = 100;
+
+    const mem_stat_t *stat = ns_dyn_mem_get_mem_stat();
+    if (stat && stat->heap_sector_size) {
+        ns_free_percent = (uint8_t)((uint64_t)(stat->heap_sector_size - stat->heap_sector_allocated_bytes) * 100 / stat->heap_sector_size);
+        level = memory_pressure_level_of(ns_free_percent);
+        if (stat->heap_alloc_fail_cnt != pressure_ns_alloc_fail_cnt) {
+            pressure_ns_alloc_fail_cnt = stat->heap_alloc_fail_cnt;
+            level = MEMORY_PRESSURE_CRITICAL;
+        }
+    }
+
+    mbed_stats_heap_t heap_stats;
+    mbed_stats_heap_get(&heap_stats);
+    if (heap_stats.reserved_size) {
+        uint32_t used = heap_stats.current_size + heap_stats.overhead_size;
+        mbed_free_percent = (used < heap_stats.reserved_size) ? (uint8_t)((uint64_t)(heap_stats.reserved_size - used) * 100 / heap_stats.reserved_size) : 0;
+        memory_pressure_level_t mbed_level = memory_pressure_level_of(mbed_free_percent);
+        if (mbed_level > level) {
+            level = mbed_level;
+        }
+    }
+
+    if (level > MEMORY_PRESSURE_CRITICAL) {
+        level = MEMORY_PRESSURE_CRITICAL;
+    }
+    if (level == pressure_level) {
+        return;
+    }
+
+    tr_info("Memory pressure %s -> %s, NS heap free: %" PRIu8 "%% MBED heap free: %" PRIu8 "%%",
+            pressure_level_names[pressure_level], pressure_level_names[level], ns_free_percent, mbed_free_percent);
+
+    memory_pressure_level_t previous_level = pressure_level;
+    pressure_level = level;
+    for (uint8_t index = 0; index < MEMORY_PRESSURE_ACTIONS_MAX && pressure_actions[index]; index++) {
+        pressure_actions[index](level, previous_level);
+    }
+}
+
+APP_EVENT_SITE(memory_pressure_sample_site, memory_pressure_sample);
+
+int memory_pressure_start(events::EventQueue *queue, uint32_t interval)
+{
+    if (!queue) {
+        return -1;
+    }
+
+    const mem_stat_t *stat = ns_dyn_mem_get_mem_stat();
+    if (stat) {
+        // Failures before the start are not counted as pressure
+        pressure_ns_alloc_fail_cnt = stat->heap_alloc_fail_cnt;
+    }
+
+    if (app_event_call_every(queue, &memory_pressure_sample_site, interval) == 0) {
+        tr_error("Memory pressure sampling cannot be scheduled");
+        return -1;
+    }
+    return 0;
+}
+
+int memory_pressure_action_register(memory_pressure_action_cb *action)
+{
+    for (uint8_t index = 0; index < MEMORY_PRESSURE_ACTIONS_MAX; index++) {
+        if (pressure_actions[index] == NULL) {
+            pressure_actions[index] = action;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+memory_pressure_level_t memory_pressure_level_get(void)
+{
+    return pressure_level;
+}
+
+#endif
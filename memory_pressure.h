@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEMORY_PRESSURE_H
+#define MEMORY_PRESSURE_H
+
+typedef enum memory_pressure_level {
+    MEMORY_PRESSURE_NORMAL = 0,
+    MEMORY_PRESSURE_ELEVATED = 1,
+    MEMORY_PRESSURE_HIGH = 2,
+    MEMORY_PRESSURE_CRITICAL = 3
+} memory_pressure_level_t;
+
+/* Called from the event queue when the pressure level changes */
+typedef void memory_pressure_action_cb(memory_pressure_level_t level, memory_pressure_level_t previous_level);
+
+/*
+ * Samples nanostack and mbed heap headroom every interval milliseconds. Level is the highest level
+ * of the two heaps, and critical when nanostack heap allocations have failed since the last sample.
+ */
+int memory_pressure_start(events::EventQueue *queue, uint32_t interval);
+/* Registers an action called on every level change, returns -1 if there is no room */
+int memory_pressure_action_register(memory_pressure_action_cb *action);
+memory_pressure_level_t memory_pressure_level_get(void);
+
+#endif /* MEMORY_PRESSURE_H */
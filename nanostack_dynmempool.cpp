@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL) && defined(MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SIZE_CLASSES)
+
+#include <inttypes.h>
+#include <string.h>
+#include "ns_types.h"
+// Slabs are allocated from nanostack heap without the tracker wrappers
+#if NSDYNMEM_TRACKER_ENABLED==1
+#undef NSDYNMEM_TRACKER_ENABLED
+#include "nsdynmemLIB.h"
+#define NSDYNMEM_TRACKER_ENABLED 1
+#else
+#include "nsdynmemLIB.h"
+#endif
+#include "ns_trace.h"
+#include "platform/mbed_critical.h"
+#include "nanostack_dynmempool.h"
+
+#define TRACE_GROUP "dynP"
+
+// Minimum number of blocks in a slab, slabs are larger when demand of the class is higher
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SLAB_BLOCKS
+#define POOL_SLAB_BLOCKS                    MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SLAB_BLOCKS
+#else
+#define POOL_SLAB_BLOCKS                    16
+#endif
+#define POOL_SLAB_BLOCKS_MAX                (POOL_SLAB_BLOCKS * 4)
+
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_POOL_MAX_SLABS
+#define POOL_MAX_SLABS                      MBED_CONF_APP_NSDYNMEMTRACKER_POOL_MAX_SLABS
+#else
+#define POOL_MAX_SLABS                      8
+#endif
+
+// Block sizes in ascending order, e.g. {16, 32, 64, 128}
+static const uint16_t pool_block_sizes[] = MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SIZE_CLASSES;
+#define POOL_CLASS_COUNT                    (sizeof(pool_block_sizes) / sizeof(pool_block_sizes[0]))
+
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block_t;
+
+typedef struct pool_slab {
+    uint8_t *start;
+    uint8_t *end;
+    uint16_t used;
+    bool from_region;           // Carved from the pool region, never released
+} pool_slab_t;
+
+typedef struct pool_class {
+    pool_block_t *free_list;
+    pool_slab_t slabs[POOL_MAX_SLABS];
+    ns_dyn_mem_pool_stats_t stats;
+} pool_class_t;
+
+static pool_class_t pool_classes[POOL_CLASS_COUNT];
+// Address range of all slabs, rejects blocks from nanostack heap without searching the slabs
+static uint8_t *pool_start = NULL;
+static uint8_t *pool_end = NULL;
+// Optional dedicated memory for the slabs, e.g. the fastest RAM, used before nanostack heap
+static uint8_t *pool_region_next = NULL;
+static uint8_t *pool_region_end = NULL;
+
+/* Block size rounded up to pointer alignment, free blocks hold the free list link */
+static uint16_t ns_dyn_mem_pool_block_size(uint8_t class_index)
+{
+    uint16_t size = pool_block_sizes[class_index];
+    if (size < sizeof(pool_block_t)) {
+        size = sizeof(pool_block_t);
+    }
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static int ns_dyn_mem_pool_class_find(ns_mem_heap_size_t size)
+{
+    for (uint8_t class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        if (size <= pool_block_sizes[class_index]) {
+            return class_index;
+        }
+    }
+    return -1;
+}
+
+/* Must be called in critical section */
+static void ns_dyn_mem_pool_range_update(void)
+{
+    pool_start = NULL;
+    pool_end = NULL;
+    for (uint8_t class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        for (uint8_t slab_index = 0; slab_index < pool_classes[class_index].stats.slabs; slab_index++) {
+            pool_slab_t *slab = &pool_classes[class_index].slabs[slab_index];
+            if (pool_start == NULL || slab->start < pool_start) {
+                pool_start = slab->start;
+            }
+            if (pool_end == NULL || slab->end > pool_end) {
+                pool_end = slab->end;
+            }
+        }
+    }
+}
+
+/* Links blocks of a new slab to the free list, must be called in critical section */
+static void ns_dyn_mem_pool_slab_add(pool_class_t *pool_class, uint8_t *start, uint32_t blocks, uint16_t block_size, bool from_region)
+{
+    pool_slab_t *slab = &pool_class->slabs[pool_class->stats.slabs++];
+    slab->start = start;
+    slab->end = start + blocks * block_size;
+    slab->used = 0;
+    slab->from_region = from_region;
+    // Linked in address order, lowest address is allocated first
+    for (uint32_t block_index = blocks; block_index > 0; block_index--) {
+        pool_block_t *block = (pool_block_t *)(start + (block_index - 1) * block_size);
+        block->next = pool_class->free_list;
+        pool_class->free_list = block;
+    }
+    pool_class->stats.capacity += blocks;
+    ns_dyn_mem_pool_range_update();
+}
+
+/*
+ * Adds a slab to the class. Slab is sized to cover the demand of the class, so that a class on the
+ * top allocators list reaches its working set with few slabs. Slabs are carved from the pool region
+ * while it has room. Otherwise they are long-term allocations placed to the end of nanostack heap,
+ * away from the short-lived temporary allocations. Only called from the demand update, so the slab
+ * count changes only here.
+ */
+static bool ns_dyn_mem_pool_class_grow(uint8_t class_index)
+{
+    pool_class_t *pool_class = &pool_classes[class_index];
+    uint16_t block_size = ns_dyn_mem_pool_block_size(class_index);
+    uint32_t blocks = POOL_SLAB_BLOCKS;
+
+    if (pool_class->stats.slabs >= POOL_MAX_SLABS) {
+        return false;
+    }
+
+    if (pool_class->stats.demand > pool_class->stats.capacity + blocks) {
+        blocks = pool_class->stats.demand - pool_class->stats.capacity;
+        if (blocks > POOL_SLAB_BLOCKS_MAX) {
+            blocks = POOL_SLAB_BLOCKS_MAX;
+        }
+    }
+
+    core_util_critical_section_enter();
+    if (pool_region_next && (uint32_t)(pool_region_end - pool_region_next) >= blocks * block_size) {
+        ns_dyn_mem_pool_slab_add(pool_class, pool_region_next, blocks, block_size, true);
+        pool_region_next += blocks * block_size;
+        core_util_critical_section_exit();
+        return true;
+    }
+    core_util_critical_section_exit();
+
+    // Nanostack heap is not allocated from the critical section
+    uint8_t *start = (uint8_t *) ns_dyn_mem_alloc(blocks * block_size);
+    if (!start) {
+        return false;
+    }
+
+    core_util_critical_section_enter();
+    ns_dyn_mem_pool_slab_add(pool_class, start, blocks, block_size, false);
+    core_util_critical_section_exit();
+
+    return true;
+}
+
+void *ns_dyn_mem_pool_alloc(ns_mem_heap_size_t size)
+{
+    int class_index = ns_dyn_mem_pool_class_find(size);
+    if (class_index < 0) {
+        return NULL;
+    }
+
+    pool_class_t *pool_class = &pool_classes[class_index];
+    core_util_critical_section_enter();
+    pool_block_t *block = pool_class->free_list;
+    if (block == NULL) {
+        // Never grows on the allocation path, the class is grown to its demand on the next update
+        pool_class->stats.fallback_count++;
+        core_util_critical_section_exit();
+        return NULL;
+    }
+
+    pool_class->free_list = block->next;
+    for (uint8_t slab_index = 0; slab_index < pool_class->stats.slabs; slab_index++) {
+        if ((uint8_t *) block >= pool_class->slabs[slab_index].start && (uint8_t *) block < pool_class->slabs[slab_index].end) {
+            pool_class->slabs[slab_index].used++;
+            break;
+        }
+    }
+    pool_class->stats.alloc_count++;
+    if (++pool_class->stats.in_use > pool_class->stats.in_use_max) {
+        pool_class->stats.in_use_max = pool_class->stats.in_use;
+    }
+    core_util_critical_section_exit();
+    return block;
+}
+
+bool ns_dyn_mem_pool_free(void *block)
+{
+    uint8_t *ptr = (uint8_t *) block;
+
+    if (ptr == NULL) {
+        return false;
+    }
+
+    core_util_critical_section_enter();
+    if (ptr < pool_start || ptr >= pool_end) {
+        core_util_critical_section_exit();
+        return false;
+    }
+
+    for (uint8_t class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        pool_class_t *pool_class = &pool_classes[class_index];
+        for (uint8_t slab_index = 0; slab_index < pool_class->stats.slabs; slab_index++) {
+            pool_slab_t *slab = &pool_class->slabs[slab_index];
+            if (ptr >= slab->start && ptr < slab->end) {
+                ((pool_block_t *) ptr)->next = pool_class->free_list;
+                pool_class->free_list = (pool_block_t *) ptr;
+                slab->used--;
+                pool_class->stats.in_use--;
+                core_util_critical_section_exit();
+                return true;
+            }
+        }
+    }
+
+    core_util_critical_section_exit();
+    return false;
+}
+
+/* Releases a slab having no allocations, if the rest of the class still covers the demand */
+static void ns_dyn_mem_pool_class_shrink(uint8_t class_index)
+{
+    pool_class_t *pool_class = &pool_classes[class_index];
+    uint16_t block_size = ns_dyn_mem_pool_block_size(class_index);
+    uint8_t *start = NULL;
+
+    core_util_critical_section_enter();
+    for (uint8_t slab_index = 0; slab_index < pool_class->stats.slabs; slab_index++) {
+        pool_slab_t *slab = &pool_class->slabs[slab_index];
+        uint32_t blocks = (slab->end - slab->start) / block_size;
+        // Leaves a slab worth of headroom so that the class does not shrink and grow on every update
+        if (slab->used > 0 || slab->from_region || pool_class->stats.capacity - blocks < pool_class->stats.demand + POOL_SLAB_BLOCKS) {
+            continue;
+        }
+
+        pool_block_t **next = &pool_class->free_list;
+        while (*next) {
+            if ((uint8_t *) *next >= slab->start && (uint8_t *) *next < slab->end) {
+                *next = (*next)->next;
+            } else {
+                next = &(*next)->next;
+            }
+        }
+        start = slab->start;
+        pool_class->stats.capacity -= blocks;
+        *slab = pool_class->slabs[--pool_class->stats.slabs];
+        ns_dyn_mem_pool_range_update();
+        break;
+    }
+    core_util_critical_section_exit();
+
+    if (start) {
+        ns_dyn_mem_free(start);
+    }
+}
+
+/*
+ * Demand of a size class is the live allocation count of the top allocators whose average allocation
+ * fits the class. Allocators with mixed sizes are counted by their average, so the demand is an estimate.
+ */
+void ns_dyn_mem_pool_demand_update(const ns_dyn_mem_tracker_lib_allocators_t *allocators, uint16_t count, uint32_t scale)
+{
+    uint32_t demand[POOL_CLASS_COUNT] = {0};
+
+    for (uint16_t list_index = 0; list_index < count && allocators[list_index].caller_addr != NULL; list_index++) {
+        if (allocators[list_index].alloc_count == 0) {
+            continue;
+        }
+        int class_index = ns_dyn_mem_pool_class_find(allocators[list_index].total_memory / allocators[list_index].alloc_count);
+        if (class_index >= 0) {
+            demand[class_index] += allocators[list_index].alloc_count * scale;
+        }
+    }
+
+    for (uint8_t class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        pool_classes[class_index].stats.demand = demand[class_index];
+        // Grows only here on the event queue, never on the allocation path
+        if (demand[class_index] > pool_classes[class_index].stats.capacity) {
+            while (demand[class_index] > pool_classes[class_index].stats.capacity) {
+                if (!ns_dyn_mem_pool_class_grow(class_index)) {
+                    break;
+                }
+            }
+        } else {
+            ns_dyn_mem_pool_class_shrink(class_index);
+        }
+    }
+}
+
+int ns_dyn_mem_pool_region_set(void *start, uint32_t size)
+{
+    if (pool_region_next) {
+        return -1;
+    }
+
+    // Blocks are pointer aligned
+    uintptr_t aligned = ((uintptr_t)start + sizeof(void *) - 1) & ~(uintptr_t)(sizeof(void *) - 1);
+    if (size < aligned - (uintptr_t)start) {
+        return -1;
+    }
+    core_util_critical_section_enter();
+    pool_region_next = (uint8_t *)aligned;
+    pool_region_end = (uint8_t *)start + size;
+    core_util_critical_section_exit();
+    return 0;
+}
+
+uint8_t ns_dyn_mem_pool_class_count(void)
+{
+    return POOL_CLASS_COUNT;
+}
+
+int ns_dyn_mem_pool_stats_get(uint8_t class_index, ns_dyn_mem_pool_stats_t *stats)
+{
+    if (class_index >= POOL_CLASS_COUNT || stats == NULL) {
+        return -1;
+    }
+
+    core_util_critical_section_enter();
+    *stats = pool_classes[class_index].stats;
+    core_util_critical_section_exit();
+    stats->block_size = pool_block_sizes[class_index];
+
+    return 0;
+}
+
+void ns_dyn_mem_pool_trace(void)
+{
+    ns_dyn_mem_pool_stats_t stats;
+
+    for (uint8_t class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        ns_dyn_mem_pool_stats_get(class_index, &stats);
+        tr_info("NSDYNMEM pool %" PRIu16 " bytes: used: %" PRIu32 "/%" PRIu32 " max: %" PRIu32 " slabs: %" PRIu8 " demand: %" PRIu32 " allocs: %" PRIu32 " fallbacks: %" PRIu32,
+                stats.block_size, stats.in_use, stats.capacity, stats.in_use_max, stats.slabs,
+                stats.demand, stats.alloc_count, stats.fallback_count);
+    }
+}
+
+#endif
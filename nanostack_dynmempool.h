@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NS_DYN_MEM_POOL_H
+#define NS_DYN_MEM_POOL_H
+
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL) && defined(MBED_CONF_APP_NSDYNMEMTRACKER_POOL_SIZE_CLASSES)
+
+#include "nsdynmem_tracker_lib.h"
+
+typedef struct ns_dyn_mem_pool_stats {
+    uint16_t block_size;        // Size class in bytes
+    uint8_t slabs;              // Slabs allocated from nanostack heap
+    uint32_t capacity;          // Blocks in the slabs
+    uint32_t in_use;            // Blocks allocated
+    uint32_t in_use_max;
+    uint32_t demand;            // Live allocations of the size class on the top allocators list
+    uint32_t alloc_count;       // Allocations served from the pool
+    uint32_t fallback_count;    // Allocations of the size class given to nanostack heap when the free list was empty
+} ns_dyn_mem_pool_stats_t;
+
+/*
+ * Allocates a block from the smallest size class that fits. Returns NULL if the size is larger than
+ * the largest size class or the free list of the class is empty, then caller allocates from nanostack
+ * heap. Never grows the class, classes are grown only by ns_dyn_mem_pool_demand_update().
+ */
+void *ns_dyn_mem_pool_alloc(ns_mem_heap_size_t size);
+
+/* Returns block to its size class. Returns false if the block is not from the pool. */
+bool ns_dyn_mem_pool_free(void *block);
+
+/*
+ * Updates the demand of the size classes from the top allocators list. Classes are grown to the demand
+ * and slabs having no allocations are released back to nanostack heap when the demand has dropped.
+ * Allocation counts are multiplied by scale, e.g. with the tracker sample rate.
+ */
+void ns_dyn_mem_pool_demand_update(const ns_dyn_mem_tracker_lib_allocators_t *allocators, uint16_t count, uint32_t scale);
+
+/*
+ * Sets memory region the slabs are carved from before nanostack heap is used, e.g. in the fastest RAM.
+ * Slabs in the region are not released. Can be set once, returns -1 on failure.
+ */
+int ns_dyn_mem_pool_region_set(void *start, uint32_t size);
+
+uint8_t ns_dyn_mem_pool_class_count(void);
+
+int ns_dyn_mem_pool_stats_get(uint8_t class_index, ns_dyn_mem_pool_stats_t *stats);
+
+void ns_dyn_mem_pool_trace(void);
+
+#else
+
+#define ns_dyn_mem_pool_alloc(size)                                     NULL
+#define ns_dyn_mem_pool_free(block)                                     false
+#define ns_dyn_mem_pool_demand_update(allocators, count, scale)
+#define ns_dyn_mem_pool_trace()
+
+#endif
+
+#endif /* NS_DYN_MEM_POOL_H */
@@ -26,13 +26,19 @@
 #include "nsdynmemLIB.h"
 #define NSDYNMEM_TRACKER_ENABLED 1
 #include "ns_trace.h"
-#include "mbedtls/md5.h"
+#include "mbedtls/base64.h"
 #else
 #include "nsdynmemLIB.h"
 #endif
 #include "events/Event.h"
-#include "events/mbed_shared_queues.h"
+#include "events/EventQueue.h"
+#include "rtos/Kernel.h"
+#include "platform/mbed_critical.h"
+#include "hal/us_ticker_api.h"
 #include "nsdynmem_tracker_lib.h"
+#include "nanostack_dynmemtracker.h"
+#include "nanostack_dynmempool.h"
+#include "app_event_queues.h"
 
 #if NSDYNMEM_TRACKER_ENABLED!=1
 #error "Enable nanostack libservice support for dynamic memory tracker: nanostack-libservice.nsdynmem-tracker-enabled"
@@ -56,15 +62,59 @@
 #define PRINT_INTERVAL                      MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
 
 #define MEM_BLOCKS_INITIAL_COUNT            500
-#define MEM_BLOCKS_MAX                      4000
+// Array grows by half of its size, but at least by this much
+#define MEM_BLOCKS_GROW_STEP                500
+// Tracker library counts the memory blocks with uint16_t
+#define MEM_BLOCKS_MAX                      0xFFFF
+
+// Records 1 in SAMPLE_RATE allocations on average, decided per allocation
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_SAMPLE_RATE
+#define SAMPLE_RATE                         MBED_CONF_APP_NSDYNMEMTRACKER_SAMPLE_RATE
+#else
+#define SAMPLE_RATE                         1
+#endif
+// Scales sampled counts back to estimates of all allocations
+#define SAMPLE_SCALE(value)                 ((value) * SAMPLE_RATE)
+
+// Snapshot is traced in base64 lines of this many snapshot bytes
+#define SNAPSHOT_TRACE_CHUNK_SIZE           384
+
+// Allocation trace of every alloc and free, drained to trace lines in the timer callback
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_ALLOC_TRACE_SIZE
+#define ALLOC_TRACE_SIZE                    MBED_CONF_APP_NSDYNMEMTRACKER_ALLOC_TRACE_SIZE
+#endif
+#define ALLOC_TRACE_MAGIC                   0x5441534E  // "NSAT"
+#define ALLOC_TRACE_HEADER_SIZE             12
+#define ALLOC_TRACE_RECORD_SIZE             20
+#define ALLOC_TRACE_RECORDS_PER_LINE        20
+#define ALLOC_TRACE_LINES_PER_SECOND        4
+
+// Leak detection, retained memory of the permanent allocator lists is sampled once per print interval
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+#define LEAK_THRESHOLD                      MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_WINDOW
+#define LEAK_WINDOW                         MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_WINDOW
+#else
+#define LEAK_WINDOW                         12
+#endif
+#define LEAK_CALLERS_COUNT                  (PERMANENT_ALLOCATORS_COUNT + TO_PERMANENT_ALLOCATORS_COUNT)
+#endif
 
 #define EXT_MEM_BLOCKS_COUNT                ((1024 << MBED_CONF_APP_NSDYNMEMTRACKER_EXT_BLOCKS_SIZE) - 1)
-#define EXT_MEM_BLOCK_MASK                  (EXT_MEM_BLOCKS_COUNT & ~1)
+// Ext memory blocks table is grown when it is this full, keeps linear probe sequences short
+#define EXT_MEM_BLOCKS_GROW_LOAD_PERCENT    75
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_EXT_BLOCKS_MAX_SIZE
+#define EXT_MEM_BLOCKS_MAX_COUNT            ((1024 << MBED_CONF_APP_NSDYNMEMTRACKER_EXT_BLOCKS_MAX_SIZE) - 1)
+#else
+#define EXT_MEM_BLOCKS_MAX_COUNT            ((1024 << 6) - 1)
+#endif
 
 static void ns_dyn_mem_tracker_timer_callback(void);
+APP_EVENT_SITE(ns_dyn_mem_tracker_timer_site, ns_dyn_mem_tracker_timer_callback);
 static ns_dyn_mem_tracker_lib_mem_blocks_t *ns_dyn_mem_tracker_allocate_mem_blocks(ns_dyn_mem_tracker_lib_mem_blocks_t *blocks, uint16_t *mem_blocks_count);
 static ns_dyn_mem_tracker_lib_mem_blocks_ext_t *ns_dyn_mem_tracker_allocate_mem_blocks_ext(ns_dyn_mem_tracker_lib_mem_blocks_ext_t *blocks, uint32_t *mem_blocks_count);
 static uint32_t ns_dyn_mem_tracker_mem_block_index_hash(void *block, uint32_t ext_mem_blocks_count);
+static void ns_dyn_mem_tracker_ext_mem_blocks_load_check(void);
 
 // Dynamic memory tracker library configuration
 static ns_dyn_mem_tracker_lib_conf_t conf = {
@@ -91,14 +141,70 @@ static ns_dyn_mem_tracker_lib_conf_t conf = {
 static events::EventQueue *equeue;
 
 static int tracker_print_interval_seconds = PRINT_INTERVAL;
+static bool tracker_traces_paused = false;
 static int max_lines_to_print_on_interval = MAX_LINES_TO_PRINT_ON_INTERVAL;
 static bool tracker_init_done = false;
 static bool tracker_disabled = false;
 static bool error_on_memory_tracker = false;
 static int equeue_event_identifier = 0;
-static ns_dyn_mem_tracker_lib_mem_blocks_ext_t mem_ext_blocks[EXT_MEM_BLOCKS_COUNT];
+static uint32_t ext_mem_blocks_used = 0;
+static uint32_t ext_mem_blocks_used_max = 0;
+static uint16_t ext_mem_blocks_grow_count = 0;
+static bool ext_mem_blocks_grow_failed = false;
+static uint16_t snapshot_sequence = 0;
+#if SAMPLE_RATE > 1
+// Longest linear probe sequence of the ext memory blocks table, bounds the lookup of unsampled blocks
+static uint32_t ext_mem_blocks_probe_max = 0;
+static uint32_t sample_countdown = 1;
+static uint32_t sample_random = 0x9E3779B9;
+#endif
 
-int8_t ns_dyn_mem_tracker_init(void)
+#ifdef ALLOC_TRACE_SIZE
+typedef enum alloc_trace_op {
+    ALLOC_TRACE_OP_ALLOC = 0,
+    ALLOC_TRACE_OP_TEMPORARY_ALLOC = 1,
+    ALLOC_TRACE_OP_FREE = 2
+} alloc_trace_op_t;
+
+typedef struct alloc_trace_record {
+    uint32_t time;              // Milliseconds
+    void *caller_addr;
+    void *block;                // NULL if the allocation failed
+    uint16_t size;
+    uint8_t op;
+    uint16_t alloc_time;        // Microseconds in the allocator, saturated
+    uint16_t tracker_time;      // Microseconds in the tracker, saturated
+} alloc_trace_record_t;
+
+static alloc_trace_record_t alloc_trace[ALLOC_TRACE_SIZE];
+// Free running indexes, records between tail and head are waiting to be traced
+static volatile uint32_t alloc_trace_head = 0;
+static volatile uint32_t alloc_trace_tail = 0;
+static volatile uint32_t alloc_trace_dropped = 0;
+static uint16_t alloc_trace_sequence = 0;
+#endif
+#ifdef LEAK_THRESHOLD
+typedef struct leak_caller {
+    void *caller_addr;              // NULL if entry is free
+    const char *function;
+    uint16_t line;
+    uint32_t sample_time[LEAK_WINDOW];      // Seconds
+    uint32_t sample_memory[LEAK_WINDOW];    // Retained bytes
+    uint8_t samples;
+    uint8_t sample_index;           // Index of the latest sample
+    uint16_t last_seen;             // Sample round the caller was last on the lists
+    bool alerted;
+} leak_caller_t;
+
+static leak_caller_t leak_callers[LEAK_CALLERS_COUNT];
+static uint16_t leak_round = 0;
+static ns_dyn_mem_tracker_leak_cb *leak_callback = NULL;
+#endif
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE) && (MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE == 1)
+static uint8_t snapshot_buffer[NS_DYN_MEM_TRACKER_SNAPSHOT_MAX_SIZE];
+#endif
+
+int8_t ns_dyn_mem_tracker_init(events::EventQueue *queue)
 {
     if (tracker_init_done) {
         return 0;
@@ -133,15 +239,15 @@ int8_t ns_dyn_mem_tracker_init(void)
         return -1;
     }
 
-    equeue = mbed::mbed_event_queue();
+    equeue = queue;
     if (equeue == NULL) {
-        tr_error("Dynamic memory tracker cannot get event queue");
+        tr_error("Dynamic memory tracker has no event queue");
         error_on_memory_tracker = true;
         return -1;
     }
 
     // Call every second
-    equeue_event_identifier = equeue->call_every(1000, ns_dyn_mem_tracker_timer_callback);
+    equeue_event_identifier = app_event_call_every(equeue, &ns_dyn_mem_tracker_timer_site, 1000);
     if (equeue_event_identifier == 0) {
         tr_error("Dynamic memory tracker cannot enable event queue periodic event");
         error_on_memory_tracker = true;
@@ -151,6 +257,188 @@ int8_t ns_dyn_mem_tracker_init(void)
     return 0;
 }
 
+void ns_dyn_mem_tracker_trace_pause(bool pause)
+{
+    tracker_traces_paused = pause;
+}
+
+/*
+ * Rehashes the ext memory blocks to a table half larger, up to EXT_MEM_BLOCKS_MAX_COUNT. Tracker
+ * library looks up blocks from a single array with linear probing, so the rehash is done at once
+ * and costs O(n) in the allocation path. Geometric growth keeps it amortised O(1) per insert.
+ */
+static bool ns_dyn_mem_tracker_ext_mem_blocks_grow(void)
+{
+    uint32_t new_count = conf.ext_mem_blocks_count + conf.ext_mem_blocks_count / 2;
+    if (new_count > EXT_MEM_BLOCKS_MAX_COUNT) {
+        new_count = EXT_MEM_BLOCKS_MAX_COUNT;
+    }
+    uint32_t used = 0;
+#if SAMPLE_RATE > 1
+    uint32_t probe_max = 0;
+#endif
+    ns_dyn_mem_tracker_lib_mem_blocks_ext_t *new_blocks;
+
+    // Tracker memory is from the system heap, independent of the nanostack heap being tracked
+    new_blocks = (ns_dyn_mem_tracker_lib_mem_blocks_ext_t *) calloc(new_count, sizeof(ns_dyn_mem_tracker_lib_mem_blocks_ext_t));
+    if (!new_blocks) {
+        return false;
+    }
+
+    for (uint32_t old_index = 0; old_index < conf.ext_mem_blocks_count; old_index++) {
+        if (conf.ext_mem_blocks[old_index].block == NULL) {
+            continue;
+        }
+        uint32_t index = ns_dyn_mem_tracker_mem_block_index_hash(conf.ext_mem_blocks[old_index].block, new_count);
+        uint32_t probe = 0;
+        while (new_blocks[index].block != NULL) {
+            index = (index + 1 < new_count) ? index + 1 : 0;
+            probe++;
+        }
+        new_blocks[index] = conf.ext_mem_blocks[old_index];
+        used++;
+#if SAMPLE_RATE > 1
+        if (probe > probe_max) {
+            probe_max = probe;
+        }
+#endif
+    }
+
+    free(conf.ext_mem_blocks);
+    conf.ext_mem_blocks = new_blocks;
+    conf.ext_mem_blocks_count = new_count;
+    // Resynchronizes the used count with the table contents
+    ext_mem_blocks_used = used;
+#if SAMPLE_RATE > 1
+    ext_mem_blocks_probe_max = probe_max;
+#endif
+    ext_mem_blocks_grow_count++;
+    return true;
+}
+
+static void ns_dyn_mem_tracker_ext_mem_blocks_load_check(void)
+{
+    ext_mem_blocks_used++;
+    if (ext_mem_blocks_used > ext_mem_blocks_used_max) {
+        ext_mem_blocks_used_max = ext_mem_blocks_used;
+    }
+
+    if (ext_mem_blocks_grow_failed || conf.ext_mem_blocks == NULL || conf.ext_mem_blocks_count >= EXT_MEM_BLOCKS_MAX_COUNT ||
+            (uint64_t)ext_mem_blocks_used * 100 < (uint64_t)conf.ext_mem_blocks_count * EXT_MEM_BLOCKS_GROW_LOAD_PERCENT) {
+        return;
+    }
+
+    if (!ns_dyn_mem_tracker_ext_mem_blocks_grow()) {
+        // Tracking continues with the current table until it is full
+        ext_mem_blocks_grow_failed = true;
+    }
+}
+
+#ifdef ALLOC_TRACE_SIZE
+/*
+ * Records are dropped and counted when the trace is full, which leaves gaps in the trace. The dropped
+ * count is sent in every trace line so that the replay can reject an incomplete trace.
+ */
+static void ns_dyn_mem_tracker_alloc_trace_record(uint8_t op, void *caller_addr, void *block, ns_mem_heap_size_t size,
+                                                  uint32_t alloc_time, uint32_t tracker_time)
+{
+#if MBED_MAJOR_VERSION > 5
+    uint32_t time = (uint32_t)rtos::Kernel::Clock::now().time_since_epoch().count();
+#else
+    uint32_t time = (uint32_t)rtos::Kernel::get_ms_count();
+#endif
+
+    core_util_critical_section_enter();
+    if (alloc_trace_head - alloc_trace_tail >= ALLOC_TRACE_SIZE) {
+        alloc_trace_dropped++;
+    } else {
+        alloc_trace_record_t *record = &alloc_trace[alloc_trace_head % ALLOC_TRACE_SIZE];
+        record->time = time;
+        record->caller_addr = caller_addr;
+        record->block = block;
+        record->size = (size > 0xFFFF) ? 0xFFFF : size;
+        record->op = op;
+        record->alloc_time = (alloc_time > 0xFFFF) ? 0xFFFF : alloc_time;
+        record->tracker_time = (tracker_time > 0xFFFF) ? 0xFFFF : tracker_time;
+        alloc_trace_head++;
+    }
+    core_util_critical_section_exit();
+}
+
+#define ns_dyn_mem_tracker_alloc_trace_time() us_ticker_read()
+#else
+#define ns_dyn_mem_tracker_alloc_trace_record(op, caller_addr, block, size, alloc_time, tracker_time) ((void)(alloc_time), (void)(tracker_time))
+#define ns_dyn_mem_tracker_alloc_trace_time() 0
+#endif
+
+#if SAMPLE_RATE > 1
+/*
+ * Decides per allocation, a decrement and branch on the fast path. Intervals between the sampled
+ * allocations are random with mean SAMPLE_RATE, so they do not lock onto periodic allocation patterns
+ * and the scaled estimates are unbiased per caller.
+ */
+static inline bool ns_dyn_mem_tracker_sample_next(void)
+{
+    if (--sample_countdown != 0) {
+        return false;
+    }
+    // xorshift32
+    sample_random ^= sample_random << 13;
+    sample_random ^= sample_random >> 17;
+    sample_random ^= sample_random << 5;
+    sample_countdown = 1 + sample_random % (2 * SAMPLE_RATE - 1);
+    return true;
+}
+
+/* Records the probe length of the block inserted by the tracker library */
+static void ns_dyn_mem_tracker_sampled_insert(void *block)
+{
+    uint32_t index = ns_dyn_mem_tracker_mem_block_index_hash(block, conf.ext_mem_blocks_count);
+
+    for (uint32_t probe = 0; probe < conf.ext_mem_blocks_count; probe++) {
+        if (conf.ext_mem_blocks[index].block == block) {
+            if (probe > ext_mem_blocks_probe_max) {
+                ext_mem_blocks_probe_max = probe;
+            }
+            return;
+        }
+        index = (index + 1 < conf.ext_mem_blocks_count) ? index + 1 : 0;
+    }
+}
+
+/*
+ * Sampled blocks are found from the ext memory blocks table. Entries are not moved after the insert,
+ * so a block not within the longest probe sequence from its hash index was not sampled. Tracker
+ * library itself would scan the whole table for a block it does not have.
+ */
+static bool ns_dyn_mem_tracker_sampled(void *block)
+{
+    if (block == NULL || conf.ext_mem_blocks == NULL) {
+        return false;
+    }
+
+    uint32_t index = ns_dyn_mem_tracker_mem_block_index_hash(block, conf.ext_mem_blocks_count);
+    for (uint32_t probe = 0; probe <= ext_mem_blocks_probe_max; probe++) {
+        if (conf.ext_mem_blocks[index].block == block) {
+            return true;
+        }
+        index = (index + 1 < conf.ext_mem_blocks_count) ? index + 1 : 0;
+    }
+    return false;
+}
+#else
+#define ns_dyn_mem_tracker_sample_next()        true
+#define ns_dyn_mem_tracker_sampled_insert(block)
+#define ns_dyn_mem_tracker_sampled(block)       true
+#endif
+
+static inline void ns_dyn_mem_tracker_block_free(void *block)
+{
+    if (!ns_dyn_mem_pool_free(block)) {
+        ns_dyn_mem_free(block);
+    }
+}
+
 extern "C" {
 
 // Wrapper for ns_dyn_mem_alloc
@@ -158,16 +446,25 @@ void *ns_dyn_mem_tracker_dyn_mem_alloc(ns_mem_heap_size_t alloc_size, const char
 {
     void *caller_addr = __builtin_extract_return_addr(__builtin_return_address(0));
 
-    if (error_on_memory_tracker) {
-        return ns_dyn_mem_alloc(alloc_size);
+    uint32_t alloc_start = ns_dyn_mem_tracker_alloc_trace_time();
+    void *block = ns_dyn_mem_pool_alloc(alloc_size);
+    if (block == NULL) {
+        block = ns_dyn_mem_alloc(alloc_size);
     }
-
-    void *block = ns_dyn_mem_alloc(alloc_size);
-
-    if (ns_dyn_mem_tracker_lib_alloc(&conf, caller_addr, function, line, block, alloc_size) < 0) {
-        error_on_memory_tracker  = true;
+    uint32_t tracker_start = ns_dyn_mem_tracker_alloc_trace_time();
+
+    if (!error_on_memory_tracker && ns_dyn_mem_tracker_sample_next()) {
+        if (ns_dyn_mem_tracker_lib_alloc(&conf, caller_addr, function, line, block, alloc_size) < 0) {
+            error_on_memory_tracker  = true;
+        } else if (block != NULL) {
+            ns_dyn_mem_tracker_sampled_insert(block);
+            ns_dyn_mem_tracker_ext_mem_blocks_load_check();
+        }
     }
 
+    ns_dyn_mem_tracker_alloc_trace_record(ALLOC_TRACE_OP_ALLOC, caller_addr, block, alloc_size, tracker_start - alloc_start,
+                                          ns_dyn_mem_tracker_alloc_trace_time() - tracker_start);
+
     return block;
 }
 
@@ -176,128 +473,129 @@ void *ns_dyn_mem_tracker_dyn_mem_temporary_alloc(ns_mem_heap_size_t alloc_size,
 {
     void *caller_addr = __builtin_extract_return_addr(__builtin_return_address(0));
 
-    if (error_on_memory_tracker) {
-        return ns_dyn_mem_temporary_alloc(alloc_size);
+    uint32_t alloc_start = ns_dyn_mem_tracker_alloc_trace_time();
+    void *block = ns_dyn_mem_pool_alloc(alloc_size);
+    if (block == NULL) {
+        block = ns_dyn_mem_temporary_alloc(alloc_size);
     }
-
-    void *block = ns_dyn_mem_temporary_alloc(alloc_size);
-
-    if (ns_dyn_mem_tracker_lib_alloc(&conf, caller_addr, function, line, block, alloc_size) < 0) {
-        error_on_memory_tracker  = true;
+    uint32_t tracker_start = ns_dyn_mem_tracker_alloc_trace_time();
+
+    if (!error_on_memory_tracker && ns_dyn_mem_tracker_sample_next()) {
+        if (ns_dyn_mem_tracker_lib_alloc(&conf, caller_addr, function, line, block, alloc_size) < 0) {
+            error_on_memory_tracker  = true;
+        } else if (block != NULL) {
+            ns_dyn_mem_tracker_sampled_insert(block);
+            ns_dyn_mem_tracker_ext_mem_blocks_load_check();
+        }
     }
 
+    ns_dyn_mem_tracker_alloc_trace_record(ALLOC_TRACE_OP_TEMPORARY_ALLOC, caller_addr, block, alloc_size, tracker_start - alloc_start,
+                                          ns_dyn_mem_tracker_alloc_trace_time() - tracker_start);
+
     return block;
 }
 
 // Wrapper for ns_dyn_mem_free
 void ns_dyn_mem_tracker_dyn_mem_free(void *block, const char *function, uint32_t line)
 {
-    if (tracker_disabled) {
-        return ns_dyn_mem_free(block);
-    }
-
     void *caller_addr = __builtin_extract_return_addr(__builtin_return_address(0));
 
-    if (ns_dyn_mem_tracker_lib_free(&conf, caller_addr, function, line, block) < 0) {
-        error_on_memory_tracker  = true;
+    uint32_t tracker_start = ns_dyn_mem_tracker_alloc_trace_time();
+
+    if (!tracker_disabled && ns_dyn_mem_tracker_sampled(block)) {
+        if (ns_dyn_mem_tracker_lib_free(&conf, caller_addr, function, line, block) < 0) {
+            error_on_memory_tracker  = true;
+        } else if (block != NULL && ext_mem_blocks_used > 0) {
+            ext_mem_blocks_used--;
+        }
     }
 
-    ns_dyn_mem_free(block);
+    // Recorded before the block is freed so that a reallocation of it is not recorded before the free
+    ns_dyn_mem_tracker_alloc_trace_record(ALLOC_TRACE_OP_FREE, caller_addr, block, 0, 0,
+                                          ns_dyn_mem_tracker_alloc_trace_time() - tracker_start);
+
+    ns_dyn_mem_tracker_block_free(block);
 }
 
 }
 
+/*
+ * Tracker library indexes the memory blocks as a single flat array, so copy-free growth is not
+ * possible. The array is grown with realloc, which extends it in place when the heap has room after
+ * it, and otherwise allocates the new array and copies, peaking at the old plus the new array.
+ * Growing by half of the size keeps that peak at 2.5 times the old array instead of 3 times when
+ * doubling, and bounds the total copying to twice the final array size.
+ */
 static ns_dyn_mem_tracker_lib_mem_blocks_t *ns_dyn_mem_tracker_allocate_mem_blocks(ns_dyn_mem_tracker_lib_mem_blocks_t *blocks, uint16_t *mem_blocks_count)
 {
-    static uint32_t alloc_size = MEM_BLOCKS_INITIAL_COUNT;
+    static uint32_t alloc_size = 0;
 
     ns_dyn_mem_tracker_lib_mem_blocks_t *new_blocks = NULL;
+    uint32_t new_size;
 
     if (blocks == NULL) {
-        new_blocks = (ns_dyn_mem_tracker_lib_mem_blocks_t *) malloc(alloc_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
-        if (!new_blocks) {
-            *mem_blocks_count = 0;
-            return NULL;
-        }
-        memset(new_blocks, 0, alloc_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
-        *mem_blocks_count = alloc_size;
+        new_size = MEM_BLOCKS_INITIAL_COUNT;
+        alloc_size = 0;
     } else {
-        if (alloc_size == MEM_BLOCKS_MAX) {
+        if (alloc_size >= MEM_BLOCKS_MAX) {
             return NULL;
         }
-        uint32_t new_size = alloc_size * 2;
+        new_size = alloc_size + (alloc_size / 2 > MEM_BLOCKS_GROW_STEP ? alloc_size / 2 : MEM_BLOCKS_GROW_STEP);
         if (new_size > MEM_BLOCKS_MAX) {
             new_size = MEM_BLOCKS_MAX;
         }
-        new_blocks = (ns_dyn_mem_tracker_lib_mem_blocks_t *) malloc(new_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
-        if (!new_blocks) {
-            free(blocks);
-            alloc_size = 0xFFFF;
-            *mem_blocks_count = 0;
-            return NULL;
-        }
-        memset(new_blocks, 0, new_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
-        memcpy(new_blocks, blocks, alloc_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
+    }
+
+    new_blocks = (ns_dyn_mem_tracker_lib_mem_blocks_t *) realloc(blocks, new_size * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
+    if (!new_blocks) {
         free(blocks);
-        alloc_size = new_size;
-        *mem_blocks_count = new_size;
+        alloc_size = MEM_BLOCKS_MAX;
+        *mem_blocks_count = 0;
+        return NULL;
     }
+    memset(new_blocks + alloc_size, 0, (new_size - alloc_size) * sizeof(ns_dyn_mem_tracker_lib_mem_blocks_t));
+    alloc_size = new_size;
+    *mem_blocks_count = new_size;
 
     return new_blocks;
 }
 
 static ns_dyn_mem_tracker_lib_mem_blocks_ext_t *ns_dyn_mem_tracker_allocate_mem_blocks_ext(ns_dyn_mem_tracker_lib_mem_blocks_ext_t *blocks, uint32_t *mem_blocks_count)
 {
-    static int calls = 0;
-    if (calls > 0) {
-        // Increase EXT_MEM_BLOCKS_COUNT if more blocks are needed
+    ns_dyn_mem_tracker_lib_mem_blocks_ext_t *new_blocks = NULL;
+
+    if (blocks != NULL) {
+        // Table is grown by ns_dyn_mem_tracker_ext_mem_blocks_load_check() before it gets full
+        *mem_blocks_count = 0;
+        return NULL;
+    }
+
+    new_blocks = (ns_dyn_mem_tracker_lib_mem_blocks_ext_t *) calloc(EXT_MEM_BLOCKS_COUNT, sizeof(ns_dyn_mem_tracker_lib_mem_blocks_ext_t));
+    if (!new_blocks) {
         *mem_blocks_count = 0;
         return NULL;
     }
-    calls++;
 
     *mem_blocks_count = EXT_MEM_BLOCKS_COUNT;
-    return mem_ext_blocks;
+    return new_blocks;
 }
 
+/*
+ * Maps block address to ext memory blocks table index. Heap blocks are at least 4 byte aligned,
+ * so alignment bits are dropped and the rest is mixed with lowbias32 integer hash. Hash is mapped
+ * to the table size with multiply-shift, which works for any table size without modulo.
+ */
 static uint32_t ns_dyn_mem_tracker_mem_block_index_hash(void *block, uint32_t ext_mem_blocks_count)
 {
-    uint32_t ret_value = 0;
-    uintptr_t number = (uintptr_t)block;
-    const unsigned char *hashed_string = (const unsigned char *) &number;
-
-    static uint8_t output[32];
-    static mbedtls_md5_context ctx;
-
-    mbedtls_md5_init(&ctx);
-
-    if (mbedtls_md5_starts_ret(&ctx) != 0) {
-        goto end;
-    }
-
-    if (mbedtls_md5_update_ret(&ctx, hashed_string, sizeof(void *)) != 0) {
-        goto end;
-    }
-
-    if (mbedtls_md5_finish_ret(&ctx, output) != 0) {
-        goto end;
-    }
+    uint32_t hash = (uint32_t)((uintptr_t)block >> 2);
 
-    ret_value = output[0] << 24;
-    ret_value |= output[1] << 16;
-    ret_value |= output[2] << 8;
-    ret_value |= output[3];
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68b;
+    hash ^= hash >> 16;
 
-    ret_value &= EXT_MEM_BLOCK_MASK;
-
-    if (ret_value >= ext_mem_blocks_count) {
-        ret_value = 0;
-    }
-
-end:
-    mbedtls_md5_free(&ctx);
-
-    return ret_value;
+    return (uint32_t)(((uint64_t)hash * ext_mem_blocks_count) >> 32);
 }
 
 static uint32_t ns_dyn_mem_tracker_trace_top_allocators(uint32_t counter)
@@ -315,8 +613,8 @@ static uint32_t ns_dyn_mem_tracker_trace_top_allocators(uint32_t counter)
         }
         tr_info("caller: %p count: %" PRIu32 " memory: %" PRIu32 " lifetime: %" PRIu32 " func: %s %" PRIu16,
             conf.top_allocators[list_index].caller_addr,   // Caller address
-            conf.top_allocators[list_index].alloc_count,   // Number of allocation
-            conf.top_allocators[list_index].total_memory,  // Total memory used by allocations
+            SAMPLE_SCALE(conf.top_allocators[list_index].alloc_count),   // Number of allocation
+            SAMPLE_SCALE(conf.top_allocators[list_index].total_memory),  // Total memory used by allocations
             conf.top_allocators[list_index].min_lifetime * ONE_STEP_IN_SECONDS, // Shortest lifetime of the allocations
             conf.top_allocators[list_index].function,      // Function name string
             conf.top_allocators[list_index].line);         // Line on module
@@ -340,8 +638,8 @@ static uint32_t ns_dyn_mem_tracker_trace_to_permanent_allocators(uint32_t counte
         }
         tr_info("caller: %p count: %" PRIu32 " memory: %" PRIu32 " lifetime: %" PRIu32 " func: %s %" PRIu16,
             conf.to_permanent_allocators[list_index].caller_addr,   // Caller address
-            conf.to_permanent_allocators[list_index].alloc_count,   // Number of allocation
-            conf.to_permanent_allocators[list_index].total_memory,  // Total memory used by allocations
+            SAMPLE_SCALE(conf.to_permanent_allocators[list_index].alloc_count),   // Number of allocation
+            SAMPLE_SCALE(conf.to_permanent_allocators[list_index].total_memory),  // Total memory used by allocations
             conf.to_permanent_allocators[list_index].min_lifetime * ONE_STEP_IN_SECONDS, // Shortest lifetime of the allocations
             conf.to_permanent_allocators[list_index].function,      // Function name string
             conf.to_permanent_allocators[list_index].line);         // Line on module
@@ -365,8 +663,8 @@ static uint32_t ns_dyn_mem_tracker_trace_permanent_allocators(uint32_t counter)
         }
         tr_info("caller: %p count: %" PRIu32 " memory: %" PRIu32 " lifetime: %" PRIu32 " func: %s %" PRIu16,
             conf.permanent_allocators[list_index].caller_addr,   // Caller address
-            conf.permanent_allocators[list_index].alloc_count,   // Number of allocation
-            conf.permanent_allocators[list_index].total_memory,  // Total memory used by allocations
+            SAMPLE_SCALE(conf.permanent_allocators[list_index].alloc_count),   // Number of allocation
+            SAMPLE_SCALE(conf.permanent_allocators[list_index].total_memory),  // Total memory used by allocations
             conf.permanent_allocators[list_index].min_lifetime * ONE_STEP_IN_SECONDS, // Shortest lifetime of the allocations
             conf.permanent_allocators[list_index].function,      // Function name string
             conf.permanent_allocators[list_index].line);         // Line on module
@@ -375,10 +673,265 @@ static uint32_t ns_dyn_mem_tracker_trace_permanent_allocators(uint32_t counter)
     return counter;
 }
 
+static uint8_t *ns_dyn_mem_tracker_write32(uint8_t *ptr, uint32_t value)
+{
+    *ptr++ = (uint8_t)value;
+    *ptr++ = (uint8_t)(value >> 8);
+    *ptr++ = (uint8_t)(value >> 16);
+    *ptr++ = (uint8_t)(value >> 24);
+    return ptr;
+}
+
+static uint8_t *ns_dyn_mem_tracker_write16(uint8_t *ptr, uint16_t value)
+{
+    *ptr++ = (uint8_t)value;
+    *ptr++ = (uint8_t)(value >> 8);
+    return ptr;
+}
+
+static uint8_t *ns_dyn_mem_tracker_snapshot_list_write(uint8_t *ptr, uint8_t *end, const ns_dyn_mem_tracker_lib_allocators_t *allocators, uint16_t count, uint8_t list, uint16_t *records)
+{
+    for (uint16_t list_index = 0; list_index < count && allocators[list_index].caller_addr != NULL; list_index++) {
+        if (ptr == NULL || end - ptr < NS_DYN_MEM_TRACKER_SNAPSHOT_RECORD_SIZE) {
+            return NULL;
+        }
+        ptr = ns_dyn_mem_tracker_write32(ptr, (uint32_t)(uintptr_t)allocators[list_index].caller_addr);
+        ptr = ns_dyn_mem_tracker_write32(ptr, SAMPLE_SCALE(allocators[list_index].alloc_count));
+        ptr = ns_dyn_mem_tracker_write32(ptr, SAMPLE_SCALE(allocators[list_index].total_memory));
+        ptr = ns_dyn_mem_tracker_write32(ptr, allocators[list_index].min_lifetime * ONE_STEP_IN_SECONDS);
+        *ptr++ = list;
+        memset(ptr, 0, 3);
+        ptr += 3;
+        (*records)++;
+    }
+    return ptr;
+}
+
+int ns_dyn_mem_tracker_snapshot_get(uint8_t *buffer, size_t buffer_size)
+{
+    uint8_t *end = buffer + buffer_size;
+    uint8_t *ptr = buffer;
+    uint16_t records = 0;
+
+    if (buffer_size < NS_DYN_MEM_TRACKER_SNAPSHOT_HEADER_SIZE || conf.top_allocators == NULL ||
+            conf.to_permanent_allocators == NULL || conf.permanent_allocators == NULL) {
+        return -1;
+    }
+
+    ptr += NS_DYN_MEM_TRACKER_SNAPSHOT_HEADER_SIZE;
+    ptr = ns_dyn_mem_tracker_snapshot_list_write(ptr, end, conf.top_allocators, conf.top_allocators_count, NS_DYN_MEM_TRACKER_LIST_TOP, &records);
+    ptr = ns_dyn_mem_tracker_snapshot_list_write(ptr, end, conf.to_permanent_allocators, conf.to_permanent_allocators_count, NS_DYN_MEM_TRACKER_LIST_TO_PERMANENT, &records);
+    ptr = ns_dyn_mem_tracker_snapshot_list_write(ptr, end, conf.permanent_allocators, conf.permanent_allocators_count, NS_DYN_MEM_TRACKER_LIST_PERMANENT, &records);
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    // Header is written last when the record count is known
+    uint8_t *header = buffer;
+    header = ns_dyn_mem_tracker_write32(header, NS_DYN_MEM_TRACKER_SNAPSHOT_MAGIC);
+    *header++ = NS_DYN_MEM_TRACKER_SNAPSHOT_VERSION;
+    *header++ = NS_DYN_MEM_TRACKER_SNAPSHOT_RECORD_SIZE;
+    header = ns_dyn_mem_tracker_write16(header, records);
+    header = ns_dyn_mem_tracker_write32(header, SAMPLE_SCALE(conf.allocated_memory));
+    header = ns_dyn_mem_tracker_write16(header, SAMPLE_RATE);
+    ns_dyn_mem_tracker_write16(header, snapshot_sequence);
+
+    return ptr - buffer;
+}
+
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE) && (MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE == 1)
+/* Traces the snapshot in base64 lines "NSDYNMEM snapshot <sequence> <part>/<parts>: <data>" */
+static void ns_dyn_mem_tracker_trace_snapshot(void)
+{
+    char line[((SNAPSHOT_TRACE_CHUNK_SIZE + 2) / 3) * 4 + 1];
+    size_t line_len;
+    int length = ns_dyn_mem_tracker_snapshot_get(snapshot_buffer, sizeof(snapshot_buffer));
+
+    if (length < 0) {
+        tr_error("NSDYNMEM snapshot failed");
+        return;
+    }
+
+    int parts = (length + SNAPSHOT_TRACE_CHUNK_SIZE - 1) / SNAPSHOT_TRACE_CHUNK_SIZE;
+    for (int part = 0; part < parts; part++) {
+        int offset = part * SNAPSHOT_TRACE_CHUNK_SIZE;
+        int chunk = (length - offset < SNAPSHOT_TRACE_CHUNK_SIZE) ? length - offset : SNAPSHOT_TRACE_CHUNK_SIZE;
+        if (mbedtls_base64_encode((unsigned char *)line, sizeof(line), &line_len, snapshot_buffer + offset, chunk) != 0) {
+            tr_error("NSDYNMEM snapshot encoding failed");
+            return;
+        }
+        tr_info("NSDYNMEM snapshot %" PRIu16 " %d/%d: %s", snapshot_sequence, part + 1, parts, line);
+    }
+}
+#endif
+
+#ifdef LEAK_THRESHOLD
+void ns_dyn_mem_tracker_leak_callback_set(ns_dyn_mem_tracker_leak_cb *callback)
+{
+    leak_callback = callback;
+}
+
+static leak_caller_t *ns_dyn_mem_tracker_leak_caller_get(void *caller_addr)
+{
+    leak_caller_t *free_entry = NULL;
+
+    for (uint16_t index = 0; index < LEAK_CALLERS_COUNT; index++) {
+        if (leak_callers[index].caller_addr == caller_addr) {
+            return &leak_callers[index];
+        }
+        // Callers that have been off the lists for a whole window are replaced
+        if (!free_entry && (leak_callers[index].caller_addr == NULL ||
+                            (uint16_t)(leak_round - leak_callers[index].last_seen) >= LEAK_WINDOW)) {
+            free_entry = &leak_callers[index];
+        }
+    }
+
+    if (free_entry) {
+        memset(free_entry, 0, sizeof(leak_caller_t));
+        free_entry->caller_addr = caller_addr;
+    }
+    return free_entry;
+}
+
+static void ns_dyn_mem_tracker_leak_sample(const ns_dyn_mem_tracker_lib_allocators_t *allocators, uint16_t count, uint32_t time)
+{
+    for (uint16_t list_index = 0; list_index < count && allocators[list_index].caller_addr != NULL; list_index++) {
+        leak_caller_t *caller = ns_dyn_mem_tracker_leak_caller_get(allocators[list_index].caller_addr);
+        if (!caller) {
+            return;
+        }
+        if (caller->samples > 0 && caller->last_seen == leak_round) {
+            // Caller is on both lists, memory is added to the sample of this round
+            caller->sample_memory[caller->sample_index] += SAMPLE_SCALE(allocators[list_index].total_memory);
+            continue;
+        }
+        caller->function = allocators[list_index].function;
+        caller->line = allocators[list_index].line;
+        caller->last_seen = leak_round;
+        caller->sample_index = (caller->samples == 0) ? 0 : (caller->sample_index + 1) % LEAK_WINDOW;
+        caller->sample_time[caller->sample_index] = time;
+        caller->sample_memory[caller->sample_index] = SAMPLE_SCALE(allocators[list_index].total_memory);
+        if (caller->samples < LEAK_WINDOW) {
+            caller->samples++;
+        }
+    }
+}
+
+/* Least squares slope of retained memory over the sample window in bytes per hour */
+static int32_t ns_dyn_mem_tracker_leak_slope(const leak_caller_t *caller)
+{
+    int64_t sum_t = 0, sum_m = 0, sum_tt = 0, sum_tm = 0;
+    int64_t n = caller->samples;
+    // Times relative to the oldest sample keep the sums small
+    uint32_t time_base = caller->sample_time[(caller->sample_index + 1) % LEAK_WINDOW];
+
+    for (uint8_t index = 0; index < caller->samples; index++) {
+        int64_t t = (int64_t)(caller->sample_time[index] - time_base);
+        int64_t m = caller->sample_memory[index];
+        sum_t += t;
+        sum_m += m;
+        sum_tt += t * t;
+        sum_tm += t * m;
+    }
+
+    int64_t denominator = n * sum_tt - sum_t * sum_t;
+    if (denominator <= 0) {
+        return 0;
+    }
+    return (int32_t)((n * sum_tm - sum_t * sum_m) * 3600 / denominator);
+}
+
+/*
+ * Samples the retained memory of the callers on the permanent and to permanent lists and alerts once
+ * when the slope over a full window exceeds the threshold. Alert is rearmed when the slope falls
+ * below half of the threshold.
+ */
+static void ns_dyn_mem_tracker_leak_update(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    uint32_t time = (uint32_t)(rtos::Kernel::Clock::now().time_since_epoch().count() / 1000);
+#else
+    uint32_t time = (uint32_t)(rtos::Kernel::get_ms_count() / 1000);
+#endif
+
+    leak_round++;
+    ns_dyn_mem_tracker_leak_sample(conf.permanent_allocators, conf.permanent_allocators_count, time);
+    ns_dyn_mem_tracker_leak_sample(conf.to_permanent_allocators, conf.to_permanent_allocators_count, time);
+
+    for (uint16_t index = 0; index < LEAK_CALLERS_COUNT; index++) {
+        leak_caller_t *caller = &leak_callers[index];
+        if (caller->caller_addr == NULL || caller->last_seen != leak_round || caller->samples < LEAK_WINDOW) {
+            continue;
+        }
+        int32_t slope = ns_dyn_mem_tracker_leak_slope(caller);
+        if (!caller->alerted && slope > LEAK_THRESHOLD) {
+            caller->alerted = true;
+            tr_warn("NSDYNMEM leak suspect caller: %p slope: %" PRId32 " B/h memory: %" PRIu32 " func: %s %" PRIu16,
+                    caller->caller_addr, slope, caller->sample_memory[caller->sample_index], caller->function, caller->line);
+            if (leak_callback) {
+                leak_callback(caller->caller_addr, caller->function, caller->line, slope, caller->sample_memory[caller->sample_index]);
+            }
+        } else if (caller->alerted && slope < LEAK_THRESHOLD / 2) {
+            caller->alerted = false;
+        }
+    }
+}
+#endif
+
+#ifdef ALLOC_TRACE_SIZE
+/*
+ * Traces the recorded allocations in base64 lines "NSDYNMEM alloc trace: <data>", data is little endian:
+ * header: magic u32, sequence u16, record count u16, dropped records u32
+ * record: time in milliseconds u32, caller address u32, block address u32, size u16, op u8, reserved u8,
+ *         allocator time in microseconds u16 (zero for free), tracker time in microseconds u16
+ */
+static void ns_dyn_mem_tracker_trace_alloc_trace(void)
+{
+    uint8_t data[ALLOC_TRACE_HEADER_SIZE + ALLOC_TRACE_RECORD_SIZE * ALLOC_TRACE_RECORDS_PER_LINE];
+    char line[((sizeof(data) + 2) / 3) * 4 + 1];
+    size_t line_len;
+
+    for (int lines = 0; lines < ALLOC_TRACE_LINES_PER_SECOND && alloc_trace_tail != alloc_trace_head; lines++) {
+        uint8_t *ptr = data + ALLOC_TRACE_HEADER_SIZE;
+        uint16_t records = 0;
+
+        // Only the recording side writes to head, so the records up to head can be read without locking
+        while (records < ALLOC_TRACE_RECORDS_PER_LINE && alloc_trace_tail != alloc_trace_head) {
+            alloc_trace_record_t *record = &alloc_trace[alloc_trace_tail % ALLOC_TRACE_SIZE];
+            ptr = ns_dyn_mem_tracker_write32(ptr, record->time);
+            ptr = ns_dyn_mem_tracker_write32(ptr, (uint32_t)(uintptr_t)record->caller_addr);
+            ptr = ns_dyn_mem_tracker_write32(ptr, (uint32_t)(uintptr_t)record->block);
+            ptr = ns_dyn_mem_tracker_write16(ptr, record->size);
+            *ptr++ = record->op;
+            *ptr++ = 0;
+            ptr = ns_dyn_mem_tracker_write16(ptr, record->alloc_time);
+            ptr = ns_dyn_mem_tracker_write16(ptr, record->tracker_time);
+            alloc_trace_tail++;
+            records++;
+        }
+
+        ptr = ns_dyn_mem_tracker_write32(data, ALLOC_TRACE_MAGIC);
+        ptr = ns_dyn_mem_tracker_write16(ptr, alloc_trace_sequence++);
+        ptr = ns_dyn_mem_tracker_write16(ptr, records);
+        ns_dyn_mem_tracker_write32(ptr, alloc_trace_dropped);
+
+        if (mbedtls_base64_encode((unsigned char *)line, sizeof(line), &line_len, data, ALLOC_TRACE_HEADER_SIZE + records * ALLOC_TRACE_RECORD_SIZE) != 0) {
+            tr_error("NSDYNMEM alloc trace encoding failed");
+            return;
+        }
+        tr_info("NSDYNMEM alloc trace: %s", line);
+    }
+}
+#endif
+
 static void ns_dyn_mem_tracker_timer_callback(void)
 {
     static int counter = 0;
 
+#ifdef ALLOC_TRACE_SIZE
+    ns_dyn_mem_tracker_trace_alloc_trace();
+#endif
+
     // Step the memory analyzer
     static int seconds_to_step = ONE_STEP_IN_SECONDS;
     if (seconds_to_step > 0) {
@@ -399,12 +952,39 @@ static void ns_dyn_mem_tracker_timer_callback(void)
             error_on_memory_tracker = true;
             tr_error("Dynamic memory tracker internal error on lists update");
         }
+        if (!error_on_memory_tracker) {
+            // Size class pools follow the working set of the top allocators
+            ns_dyn_mem_pool_demand_update(conf.top_allocators, conf.top_allocators_count, SAMPLE_RATE);
+#ifdef LEAK_THRESHOLD
+            ns_dyn_mem_tracker_leak_update();
+#endif
+        }
+        snapshot_sequence++;
+
+        if (tracker_traces_paused) {
+            // Lists were updated above, only the traces of this interval are skipped
+            counter = tracker_print_interval_seconds;
+            return;
+        }
 
         max_lines_to_print = max_lines_to_print_on_interval;
 
         tr_info("NSDYNMEM total memory: %" PRIu32 " allocators: %" PRIu16 " blocks: %" PRIu32 " last: %" PRIu16 " err: %s", conf.allocated_memory, conf.mem_blocks_count, conf.ext_mem_blocks_count, conf.last_mem_block_index, error_on_memory_tracker ? "ERROR" : "NONE");
+#if SAMPLE_RATE > 1
+        tr_info("NSDYNMEM 1 in %d allocations sampled, estimated total memory: %" PRIu32, SAMPLE_RATE, SAMPLE_SCALE(conf.allocated_memory));
+#endif
+        tr_info("NSDYNMEM blocks used: %" PRIu32 " max: %" PRIu32 " load: %" PRIu32 "%% grows: %" PRIu16 "%s",
+                ext_mem_blocks_used, ext_mem_blocks_used_max,
+                conf.ext_mem_blocks_count ? (uint32_t)((uint64_t)ext_mem_blocks_used * 100 / conf.ext_mem_blocks_count) : 0,
+                ext_mem_blocks_grow_count, ext_mem_blocks_grow_failed ? " grow failed" : "");
+        ns_dyn_mem_pool_trace();
         counter++;
     } else if (counter == tracker_print_interval_seconds - 3) {
+#if defined(MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE) && (MBED_CONF_APP_NSDYNMEMTRACKER_BINARY_TRACE == 1)
+        // All lists in one binary snapshot instead of a line per allocator
+        ns_dyn_mem_tracker_trace_snapshot();
+        max_lines_to_print = 0;
+#endif
         // Trace list of allocators going to list of allocators having permanent memory blocks
         max_lines_to_print = ns_dyn_mem_tracker_trace_to_permanent_allocators(max_lines_to_print);
         counter++;
@@ -19,11 +19,48 @@
 
 #ifdef MBED_CONF_APP_NSDYNMEMTRACKER_PRINT_INTERVAL
 
-int8_t ns_dyn_mem_tracker_init(void);
+#define NS_DYN_MEM_TRACKER_SNAPSHOT_MAGIC           0x544D534E  // "NSMT"
+#define NS_DYN_MEM_TRACKER_SNAPSHOT_VERSION         1
+#define NS_DYN_MEM_TRACKER_SNAPSHOT_HEADER_SIZE     16
+#define NS_DYN_MEM_TRACKER_SNAPSHOT_RECORD_SIZE     20
+// Top, to permanent (twice the top allocators) and permanent allocators lists
+#define NS_DYN_MEM_TRACKER_SNAPSHOT_MAX_SIZE        (NS_DYN_MEM_TRACKER_SNAPSHOT_HEADER_SIZE + \
+                                                     NS_DYN_MEM_TRACKER_SNAPSHOT_RECORD_SIZE * 4 * MBED_CONF_APP_NSDYNMEMTRACKER_TOP_ALLOCATORS)
+
+typedef enum ns_dyn_mem_tracker_snapshot_list {
+    NS_DYN_MEM_TRACKER_LIST_TOP = 0,
+    NS_DYN_MEM_TRACKER_LIST_TO_PERMANENT = 1,
+    NS_DYN_MEM_TRACKER_LIST_PERMANENT = 2
+} ns_dyn_mem_tracker_snapshot_list_t;
+
+/* Tracker runs its once per second sampling and the periodic prints in the given queue */
+int8_t ns_dyn_mem_tracker_init(events::EventQueue *queue);
+
+/* Skips the interval traces while paused, tracking and the allocator list updates continue */
+void ns_dyn_mem_tracker_trace_pause(bool pause);
+
+/*
+ * Writes the allocator lists of the last interval as a binary snapshot, all fields little endian:
+ * header: magic u32, version u8, record size u8, record count u16, total memory u32, sample rate u16, sequence u16
+ * record: caller address u32, allocation count u32, memory u32, min lifetime in seconds u32, list u8, reserved u8[3]
+ * Counts and memory are scaled by the sample rate. Returns length or -1 if the buffer is too small.
+ */
+int ns_dyn_mem_tracker_snapshot_get(uint8_t *buffer, size_t buffer_size);
+
+#ifdef MBED_CONF_APP_NSDYNMEMTRACKER_LEAK_THRESHOLD
+/*
+ * Called from the event queue when retained memory of a caller on the permanent allocator lists grows
+ * faster than nsdynmemtracker-leak-threshold bytes per hour, slope is in bytes per hour.
+ */
+typedef void ns_dyn_mem_tracker_leak_cb(void *caller_addr, const char *function, uint16_t line, int32_t slope, uint32_t memory);
+
+void ns_dyn_mem_tracker_leak_callback_set(ns_dyn_mem_tracker_leak_cb *callback);
+#endif
 
 #else
 
-#define ns_dyn_mem_tracker_init()
+#define ns_dyn_mem_tracker_init(queue)
+#define ns_dyn_mem_tracker_trace_pause(pause)
 
 #endif
 
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "NetworkInterface.h"
+#include "randLIB.h"
+#include "mbed-trace/mbed_trace.h"
+#include "app_event_queues.h"
+#include "network_backhaul.h"
+
+#define TRACE_GROUP "aBhL"  //Application Backhaul Link
+
+// Backoff base and cap, retry n waits a random time up to min(cap, base * 2^n)
+#ifndef BACKHAUL_CONNECTION_RETRY_TIMEOUT
+#define BACKHAUL_CONNECTION_RETRY_TIMEOUT 1000
+#endif
+#ifndef BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX
+#define BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX 300*1000
+#endif
+// Time the interface has to come up after connect, e.g. for DHCP
+#ifndef BACKHAUL_CONNECTION_TIMEOUT
+#define BACKHAUL_CONNECTION_TIMEOUT 60*1000
+#endif
+
+static events::EventQueue *backhaul_queue = NULL;
+static NetworkInterface *backhaul_interface = NULL;
+static network_backhaul_connected_cb *backhaul_connected_cb = NULL;
+static network_backhaul_stats_t backhaul_stats;
+static int backhaul_event_id = 0;
+static uint8_t backhaul_retry_count = 0;
+static uint64_t backhaul_start_time = 0;
+static uint64_t backhaul_lost_time = 0;
+static bool backhaul_connected_once = false;
+
+static void network_backhaul_attempt(void);
+static void network_backhaul_timeout(void);
+APP_EVENT_SITE(network_backhaul_attempt_site, network_backhaul_attempt);
+APP_EVENT_SITE(network_backhaul_timeout_site, network_backhaul_timeout);
+
+static uint64_t network_backhaul_time_ms(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    return Kernel::Clock::now().time_since_epoch().count();
+#else
+    return Kernel::get_ms_count();
+#endif
+}
+
+/* Full jitter, border routers restarted together spread their attempts over the whole backoff window */
+static uint32_t network_backhaul_backoff(void)
+{
+    uint32_t ceiling = BACKHAUL_CONNECTION_RETRY_TIMEOUT_MAX;
+
+    if (backhaul_retry_count < 32) {
+        uint64_t exponential = (uint64_t)BACKHAUL_CONNECTION_RETRY_TIMEOUT << backhaul_retry_count;
+        if (exponential < ceiling) {
+            ceiling = (uint32_t)exponential;
+        }
+    }
+    return randLIB_get_32bit() % (ceiling + 1);
+}
+
+static void network_backhaul_event_cancel(void)
+{
+    if (backhaul_event_id) {
+        backhaul_queue->cancel(backhaul_event_id);
+        backhaul_event_id = 0;
+    }
+}
+
+static void network_backhaul_retry(int status)
+{
+    network_backhaul_event_cancel();
+    (void) backhaul_interface->disconnect();
+
+    uint32_t delay = network_backhaul_backoff();
+    if (backhaul_retry_count < UINT8_MAX) {
+        backhaul_retry_count++;
+    }
+    backhaul_stats.state = NETWORK_BACKHAUL_WAIT_RETRY;
+    tr_warn("Failed to connect! error=%d. Retry %" PRIu8 " in %" PRIu32 " ms", status, backhaul_retry_count, delay);
+    backhaul_event_id = app_event_call_in(backhaul_queue, &network_backhaul_attempt_site, delay);
+    if (backhaul_event_id == 0) {
+        tr_error("Backhaul connection retry cannot be scheduled");
+    }
+}
+
+static void network_backhaul_connected(void)
+{
+    SocketAddress sa;
+
+    network_backhaul_event_cancel();
+    int status = backhaul_interface->get_ip_address(&sa);
+    if (status != NSAPI_ERROR_OK) {
+        tr_debug("Backhaul get_ip_address() - failed, status %d", status);
+        network_backhaul_retry(status);
+        return;
+    }
+
+    uint64_t now = network_backhaul_time_ms();
+    backhaul_stats.state = NETWORK_BACKHAUL_CONNECTED;
+    backhaul_retry_count = 0;
+    if (!backhaul_connected_once) {
+        backhaul_connected_once = true;
+        backhaul_stats.time_to_backhaul = (uint32_t)(now - backhaul_start_time);
+        tr_info("Backhaul Interface connected with IP %s in %" PRIu32 " ms, attempts %" PRIu32,
+                sa.get_ip_address() ? sa.get_ip_address() : "None", backhaul_stats.time_to_backhaul, backhaul_stats.attempts);
+    } else {
+        backhaul_stats.reconnections++;
+        backhaul_stats.last_outage = (uint32_t)(now - backhaul_lost_time);
+        tr_info("Backhaul Interface reconnected with IP %s after %" PRIu32 " ms outage",
+                sa.get_ip_address() ? sa.get_ip_address() : "None", backhaul_stats.last_outage);
+    }
+
+    if (backhaul_connected_cb) {
+        backhaul_connected_cb();
+    }
+}
+
+static void network_backhaul_timeout(void)
+{
+    backhaul_event_id = 0;
+    network_backhaul_retry(NSAPI_ERROR_CONNECTION_TIMEOUT);
+}
+
+static void network_backhaul_attempt(void)
+{
+    backhaul_event_id = 0;
+    backhaul_stats.attempts++;
+    backhaul_stats.state = NETWORK_BACKHAUL_CONNECTING;
+
+    int status = backhaul_interface->connect();
+    tr_info("Backhaul MAC Address: %s", backhaul_interface->get_mac_address() ? backhaul_interface->get_mac_address() : "None");
+    if (status == NSAPI_ERROR_IS_CONNECTED || (status == NSAPI_ERROR_OK && backhaul_interface->get_connection_status() == NSAPI_STATUS_GLOBAL_UP)) {
+        network_backhaul_connected();
+    } else if (status == NSAPI_ERROR_OK || status == NSAPI_ERROR_IN_PROGRESS || status == NSAPI_ERROR_ALREADY || status == NSAPI_ERROR_BUSY) {
+        // Interface reports the connection with a status event
+        backhaul_event_id = app_event_call_in(backhaul_queue, &network_backhaul_timeout_site, BACKHAUL_CONNECTION_TIMEOUT);
+    } else {
+        network_backhaul_retry(status);
+    }
+}
+
+static void network_backhaul_status_handle(nsapi_connection_status_t status)
+{
+    switch (status) {
+        case NSAPI_STATUS_GLOBAL_UP:
+            // Also while backing off, e.g. when the link comes up after a switch reboot
+            if (backhaul_stats.state != NETWORK_BACKHAUL_CONNECTED) {
+                network_backhaul_connected();
+            }
+            break;
+        case NSAPI_STATUS_DISCONNECTED:
+            if (backhaul_stats.state == NETWORK_BACKHAUL_CONNECTED) {
+                tr_warn("Backhaul Interface connection lost");
+                backhaul_lost_time = network_backhaul_time_ms();
+                // Non-blocking interface reconnects when the link returns, retry only if it does not
+                backhaul_stats.state = NETWORK_BACKHAUL_CONNECTING;
+                network_backhaul_event_cancel();
+                backhaul_event_id = app_event_call_in(backhaul_queue, &network_backhaul_timeout_site, BACKHAUL_CONNECTION_TIMEOUT);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Status events come from the stack thread, handling is done in the event queue
+static void network_backhaul_status_cb(nsapi_event_t event, intptr_t value)
+{
+    if (event == NSAPI_EVENT_CONNECTION_STATUS_CHANGE) {
+        backhaul_queue->call(network_backhaul_status_handle, (nsapi_connection_status_t)value);
+    }
+}
+
+int network_backhaul_start(events::EventQueue *queue, NetworkInterface *interface, network_backhaul_connected_cb *connected_cb)
+{
+    if (!queue || !interface || backhaul_interface) {
+        return -1;
+    }
+
+    backhaul_queue = queue;
+    backhaul_interface = interface;
+    backhaul_connected_cb = connected_cb;
+    backhaul_start_time = network_backhaul_time_ms();
+    // Jitter must differ between border routers powered up together
+    randLIB_seed_random();
+
+    if (backhaul_interface->set_blocking(false) != NSAPI_ERROR_OK) {
+        tr_warn("Backhaul Interface does not support non-blocking connect, connect blocks the event queue");
+    }
+    backhaul_interface->add_event_listener(mbed::callback(&network_backhaul_status_cb));
+
+    backhaul_event_id = app_event_call(backhaul_queue, &network_backhaul_attempt_site);
+    if (backhaul_event_id == 0) {
+        tr_error("Backhaul connection cannot be scheduled");
+        return -1;
+    }
+    return 0;
+}
+
+void network_backhaul_stats_get(network_backhaul_stats_t *stats)
+{
+    *stats = backhaul_stats;
+}
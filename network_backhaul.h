@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_BACKHAUL_H
+#define NETWORK_BACKHAUL_H
+
+typedef enum network_backhaul_state {
+    NETWORK_BACKHAUL_IDLE = 0,
+    NETWORK_BACKHAUL_CONNECTING,    // Waiting for the interface to come up
+    NETWORK_BACKHAUL_WAIT_RETRY,    // Backing off after a failed attempt
+    NETWORK_BACKHAUL_CONNECTED
+} network_backhaul_state_t;
+
+typedef struct network_backhaul_stats {
+    network_backhaul_state_t state;
+    uint32_t time_to_backhaul;      // Milliseconds from the start to the first connection
+    uint32_t last_outage;           // Milliseconds from the last connection loss to the reconnection
+    uint32_t attempts;              // Connect attempts
+    uint32_t reconnections;         // Connections after a connection loss
+} network_backhaul_stats_t;
+
+/* Called from the event queue when the backhaul is connected, also after a connection loss */
+typedef void network_backhaul_connected_cb(void);
+
+/*
+ * Connects the backhaul interface in the event queue without blocking the caller. Failed attempts are
+ * retried with exponential backoff and full jitter, and a connection reported by the interface is taken
+ * into use immediately, also while backing off. Connection losses are reconnected the same way.
+ */
+int network_backhaul_start(events::EventQueue *queue, NetworkInterface *interface, network_backhaul_connected_cb *connected_cb);
+void network_backhaul_stats_get(network_backhaul_stats_t *stats);
+
+#endif /* NETWORK_BACKHAUL_H */
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#if (defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) && (MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY == 1)) || \
+    (defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1))
+
+#include "mbed.h"
+#include "network_dns_msg.h"
+
+#define DNS_TYPE_SOA                    6
+#define DNS_TYPE_AAAA                   28
+#define DNS_TYPE_OPT                    41
+#define DNS_RR_FIXED_SIZE               10      // Type, class, TTL and RDLENGTH
+#define DNS_SOA_FIXED_SIZE              20      // Serial, refresh, retry, expire and minimum
+
+static uint16_t dns_msg_read16(const uint8_t *ptr)
+{
+    return (uint16_t)((ptr[0] << 8) | ptr[1]);
+}
+
+static uint32_t dns_msg_read32(const uint8_t *ptr)
+{
+    return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+}
+
+static void dns_msg_write32(uint8_t *ptr, uint32_t value)
+{
+    ptr[0] = (uint8_t)(value >> 24);
+    ptr[1] = (uint8_t)(value >> 16);
+    ptr[2] = (uint8_t)(value >> 8);
+    ptr[3] = (uint8_t)value;
+}
+
+int network_dns_msg_name_skip(const uint8_t *msg, uint16_t msg_len, int offset)
+{
+    while (offset < msg_len) {
+        uint8_t label_len = msg[offset];
+        if (label_len == 0) {
+            return offset + 1;
+        }
+        if ((label_len & 0xC0) == 0xC0) {
+            // Compression pointer ends the name
+            return (offset + 2 <= msg_len) ? offset + 2 : -1;
+        }
+        if (label_len & 0xC0) {
+            return -1;
+        }
+        offset += label_len + 1;
+    }
+    return -1;
+}
+
+int network_dns_msg_question_parse(const uint8_t *msg, uint16_t msg_len, network_dns_msg_question_t *question)
+{
+    int offset = NETWORK_DNS_MSG_HEADER_SIZE;
+    uint16_t qname_len = 0;
+
+    if (msg_len < NETWORK_DNS_MSG_HEADER_SIZE || dns_msg_read16(msg + 4) != 1) {
+        return -1;
+    }
+
+    // Question names of queries are never compressed
+    while (offset < msg_len) {
+        uint8_t label_len = msg[offset];
+        if (label_len & 0xC0 || offset + label_len + 1 > msg_len || qname_len + label_len + 1 > NETWORK_DNS_MSG_QNAME_MAX_SIZE) {
+            return -1;
+        }
+        question->qname[qname_len++] = label_len;
+        offset++;
+        if (label_len == 0) {
+            break;
+        }
+        for (uint8_t i = 0; i < label_len; i++) {
+            uint8_t c = msg[offset++];
+            question->qname[qname_len++] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+    }
+
+    if (qname_len == 0 || question->qname[qname_len - 1] != 0 || offset + 4 > msg_len) {
+        return -1;
+    }
+
+    question->qname_len = qname_len;
+    question->qtype = dns_msg_read16(msg + offset);
+    question->qclass = dns_msg_read16(msg + offset + 2);
+    return offset + 4;
+}
+
+int network_dns_msg_rr_walk(uint8_t *msg, uint16_t msg_len, uint32_t age, network_dns_msg_rr_info_t *info)
+{
+    if (msg_len < NETWORK_DNS_MSG_HEADER_SIZE) {
+        return -1;
+    }
+
+    uint16_t an_count = dns_msg_read16(msg + 6);
+    uint16_t ns_count = dns_msg_read16(msg + 8);
+    uint16_t ar_count = dns_msg_read16(msg + 10);
+    int offset = network_dns_msg_name_skip(msg, msg_len, NETWORK_DNS_MSG_HEADER_SIZE);
+
+    if (offset < 0 || offset + 4 > msg_len) {
+        return -1;
+    }
+    offset += 4;
+
+    info->answer_min_ttl = UINT32_MAX;
+    info->negative_ttl = 0;
+    info->soa_found = false;
+
+    for (uint32_t rr = 0; rr < (uint32_t)an_count + ns_count + ar_count; rr++) {
+        offset = network_dns_msg_name_skip(msg, msg_len, offset);
+        if (offset < 0 || offset + DNS_RR_FIXED_SIZE > msg_len) {
+            return -1;
+        }
+
+        uint16_t type = dns_msg_read16(msg + offset);
+        uint32_t ttl = dns_msg_read32(msg + offset + 4);
+        uint16_t rdlength = dns_msg_read16(msg + offset + 8);
+        if (offset + DNS_RR_FIXED_SIZE + rdlength > msg_len) {
+            return -1;
+        }
+
+        // TTL field of OPT pseudo record holds flags
+        if (type != DNS_TYPE_OPT) {
+            ttl = (ttl > age) ? ttl - age : 0;
+            dns_msg_write32(msg + offset + 4, ttl);
+            if (rr < an_count && ttl < info->answer_min_ttl) {
+                info->answer_min_ttl = ttl;
+            }
+            if (rr >= an_count && rr < (uint32_t)an_count + ns_count && type == DNS_TYPE_SOA && rdlength >= DNS_SOA_FIXED_SIZE) {
+                // Negative answers are cached for the smaller of SOA TTL and SOA MINIMUM
+                uint32_t minimum = dns_msg_read32(msg + offset + DNS_RR_FIXED_SIZE + rdlength - 4);
+                info->negative_ttl = (ttl < minimum) ? ttl : minimum;
+                info->soa_found = true;
+            }
+        }
+        offset += DNS_RR_FIXED_SIZE + rdlength;
+    }
+    return 0;
+}
+
+bool network_dns_msg_question_match(const uint8_t *msg, uint16_t msg_len, const char *name, uint16_t qtype)
+{
+    int offset = NETWORK_DNS_MSG_HEADER_SIZE;
+
+    if (msg_len < NETWORK_DNS_MSG_HEADER_SIZE || dns_msg_read16(msg + 4) != 1) {
+        return false;
+    }
+
+    while (offset < msg_len) {
+        uint8_t label_len = msg[offset++];
+        if (label_len == 0) {
+            return *name == '\0' && offset + 4 <= msg_len && dns_msg_read16(msg + offset) == qtype;
+        }
+        const char *name_label_end = strchr(name, '.');
+        size_t name_label_len = name_label_end ? (size_t)(name_label_end - name) : strlen(name);
+        // Label lengths are compared first, so a label with a dot or a null character never matches
+        if (label_len & 0xC0 || offset + label_len > msg_len || label_len != name_label_len ||
+                memchr(msg + offset, '\0', label_len) != NULL || strncasecmp((const char *)msg + offset, name, label_len) != 0) {
+            return false;
+        }
+        offset += label_len;
+        name += label_len;
+        if (*name == '.') {
+            name++;
+        }
+    }
+    return false;
+}
+
+bool network_dns_msg_aaaa_parse(const uint8_t *msg, uint16_t msg_len, uint8_t *address, uint32_t *ttl)
+{
+    if (msg_len < NETWORK_DNS_MSG_HEADER_SIZE) {
+        return false;
+    }
+
+    uint16_t an_count = dns_msg_read16(msg + 6);
+    int offset = network_dns_msg_name_skip(msg, msg_len, NETWORK_DNS_MSG_HEADER_SIZE);
+    bool found = false;
+
+    if (offset < 0 || offset + 4 > msg_len) {
+        return false;
+    }
+    offset += 4;
+    *ttl = UINT32_MAX;
+
+    for (uint16_t i = 0; i < an_count; i++) {
+        offset = network_dns_msg_name_skip(msg, msg_len, offset);
+        if (offset < 0 || offset + DNS_RR_FIXED_SIZE > msg_len) {
+            return false;
+        }
+        uint16_t type = dns_msg_read16(msg + offset);
+        uint32_t rr_ttl = dns_msg_read32(msg + offset + 4);
+        uint16_t rdlength = dns_msg_read16(msg + offset + 8);
+        if (offset + DNS_RR_FIXED_SIZE + rdlength > msg_len) {
+            return false;
+        }
+
+        // CNAME chain and the address share the smallest TTL
+        if (rr_ttl < *ttl) {
+            *ttl = rr_ttl;
+        }
+        if (!found && type == DNS_TYPE_AAAA && rdlength == NETWORK_DNS_MSG_IPV6_SIZE) {
+            memcpy(address, msg + offset + DNS_RR_FIXED_SIZE, NETWORK_DNS_MSG_IPV6_SIZE);
+            found = true;
+        }
+        offset += DNS_RR_FIXED_SIZE + rdlength;
+    }
+    return found;
+}
+#endif  //defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) || defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION)
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_DNS_MSG_H
+#define NETWORK_DNS_MSG_H
+
+/* Parsers of the DNS messages of the DNS proxy and resolver, messages come from the network and are untrusted */
+
+#define NETWORK_DNS_MSG_HEADER_SIZE     12
+#define NETWORK_DNS_MSG_QNAME_MAX_SIZE  255
+#define NETWORK_DNS_MSG_IPV6_SIZE       16
+
+typedef struct network_dns_msg_question {
+    uint8_t qname[NETWORK_DNS_MSG_QNAME_MAX_SIZE];  // Wire format, lower case
+    uint16_t qname_len;
+    uint16_t qtype;
+    uint16_t qclass;
+} network_dns_msg_question_t;
+
+typedef struct network_dns_msg_rr_info {
+    uint32_t answer_min_ttl;    // UINT32_MAX if there are no answers
+    uint32_t negative_ttl;      // Smaller of SOA TTL and SOA MINIMUM, valid if soa_found
+    bool soa_found;
+} network_dns_msg_rr_info_t;
+
+/* Returns offset after the name at offset, a compression pointer ends the name and is not followed, -1 if malformed */
+int network_dns_msg_name_skip(const uint8_t *msg, uint16_t msg_len, int offset);
+
+/* Parses the single uncompressed question of a message, returns offset after the question or -1 */
+int network_dns_msg_question_parse(const uint8_t *msg, uint16_t msg_len, network_dns_msg_question_t *question);
+
+/*
+ * Walks the resource records of a response. Finds the smallest answer TTL and the negative caching
+ * TTL from the SOA record of the authority section, and decreases every TTL by age seconds in place.
+ * Returns 0 on success, -1 if the message is malformed.
+ */
+int network_dns_msg_rr_walk(uint8_t *msg, uint16_t msg_len, uint32_t age, network_dns_msg_rr_info_t *info);
+
+/* Returns true if the single question of the message is the dotted name with the type, names are compared case insensitively */
+bool network_dns_msg_question_match(const uint8_t *msg, uint16_t msg_len, const char *name, uint16_t qtype);
+
+/* Finds the first AAAA answer and the smallest answer TTL, returns false if there is none or the message is malformed */
+bool network_dns_msg_aaaa_parse(const uint8_t *msg, uint16_t msg_len, uint8_t *address, uint32_t *ttl);
+
+#endif /* NETWORK_DNS_MSG_H */
@@ -21,158 +21,716 @@
 #include "mbed-cloud-client/MbedCloudClient.h"
 #include "factory_configurator_client.h"
 #include "mbed-trace/mbed_trace.h"
+#include "randLIB.h"
+#include "kvstore_global_api.h"
+#include "network_dns_resolver.h"
+#include "network_dns_uri.h"
+#include "network_dns_optimization.h"
+#include "app_event_queues.h"
 
 #define TRACE_GROUP "aDoM"  //Application DNS Optimization Module
 
+#ifndef DNS_OPT_RECORD_TTL
+#ifdef MBED_CONF_APP_WISUN_NETWORK_DNS_TTL
+#define DNS_OPT_RECORD_TTL          (MBED_CONF_APP_WISUN_NETWORK_DNS_TTL*1000)
+#else
+#define DNS_OPT_RECORD_TTL          60*60*1000     // 1 Hour
+#endif
+#endif
+
+#ifndef DNS_OPT_RETRY_TIMEOUT
+#define DNS_OPT_RETRY_TIMEOUT       30*1000        // 30 Seconds
+#endif
+// Answers are refreshed at their TTL, capped by DNS_OPT_RECORD_TTL, but not more often than this
+#ifndef DNS_OPT_REFRESH_MIN_TIME
+#define DNS_OPT_REFRESH_MIN_TIME    30*1000        // 30 Seconds
+#endif
+#ifndef DNS_OPT_RETRY_TIMEOUT_MAX
+#define DNS_OPT_RETRY_TIMEOUT_MAX   30*60*1000     // 30 Minutes
+#endif
+
+// Refreshes of names having an answer are postponed by this much while postponing is requested
+#define DNS_OPT_POSTPONE_TIME       5*60*1000      // 5 Minutes
+
+// Refresh and retry times are randomized down by up to this percentage
+#define DNS_OPT_JITTER_PERCENT      10
+
+#ifdef MBED_CONF_APP_WISUN_NETWORK_DNS_NAMES_MAX
+#define DNS_OPT_NAMES_MAX           MBED_CONF_APP_WISUN_NETWORK_DNS_NAMES_MAX
+#else
+#define DNS_OPT_NAMES_MAX           4
+#endif
+
+#define DNS_OPT_NAME_MAX_LEN        128
+
+// Cached answers older than this are not replayed after reboot
+#ifndef DNS_OPT_CACHE_MAX_AGE
+#define DNS_OPT_CACHE_MAX_AGE       7*24*60*60     // 7 Days
+#endif
+// Unchanged answers are written to KVStore at most this often
+#ifndef DNS_OPT_CACHE_SAVE_INTERVAL
+#define DNS_OPT_CACHE_SAVE_INTERVAL 24*60*60*1000  // 24 Hours
+#endif
+// Changed answers are written at most this often, round-robin names can change on every refresh
+#ifndef DNS_OPT_CACHE_SAVE_MIN_INTERVAL
+#define DNS_OPT_CACHE_SAVE_MIN_INTERVAL 15*60*1000 // 15 Minutes
+#endif
+// Wall clock before this is not set (2020-01-01), age of cached answers is unknown
+#define DNS_OPT_VALID_TIME          1577836800
+#define DNS_OPT_CACHE_VERSION       1
+#define DNS_OPT_NAMES_LIST_MAX_LEN  256
+
+typedef enum dns_opt_source {
+    DNS_OPT_SOURCE_NONE = 0,
+    DNS_OPT_SOURCE_KCM,         // Pelion server URIs in the KCM config store
+    DNS_OPT_SOURCE_CONFIG,      // Compile time list
+    DNS_OPT_SOURCE_RESOURCE     // LwM2M resource
+} dns_opt_source_t;
+
+typedef struct dns_opt_entry {
+    char name[DNS_OPT_NAME_MAX_LEN];    // Host name to resolve, empty if entry is free
+    dns_opt_source_t source;
+    uint64_t next_refresh;      // Time of the next query in milliseconds
+    uint32_t retry_timeout;     // Current retry backoff in milliseconds
+    bool query_pending;         // Query sent, waiting for the callback
+    int query_id;               // Resolver query id while the query is pending
+    bool published;             // Answer is set to the border router
+    bool resolved;              // Address is valid, resolved now or restored from KVStore
+    SocketAddress address;
+    time_t resolved_time;       // Wall clock of the resolution, 0 if not known
+    uint32_t ttl;               // TTL of the answer in seconds
+    uint64_t refreshed_time;    // Time of the last answer from backhaul in milliseconds, 0 if restored from KVStore
+    uint64_t query_time;        // Time the pending query was sent in milliseconds
+} dns_opt_entry_t;
+
+// Last good answers stored in KVStore
+typedef struct dns_opt_cache_record {
+    char name[DNS_OPT_NAME_MAX_LEN];
+    uint8_t address[NSAPI_IPv6_BYTES];
+    uint32_t ttl;               // Seconds
+    int64_t resolved_time;      // Wall clock of the resolution, 0 if not known
+} dns_opt_cache_record_t;
+
+typedef struct dns_opt_cache {
+    uint8_t version;
+    uint8_t count;
+    dns_opt_cache_record_t records[DNS_OPT_NAMES_MAX];
+} dns_opt_cache_t;
+
 static WisunBorderRouter *ws_br;
 static NetworkInterface *backbone_interface;
-static char *lwm2m_server_name = NULL;
-static char *bootstrap_server_name = NULL;
-static char network_interface_name[10];
+static EventQueue *dns_opt_queue = NULL;
+static int dns_opt_event_id = 0;
+static dns_opt_entry_t dns_opt_entries[DNS_OPT_NAMES_MAX];
+static char dns_opt_resource_names[DNS_OPT_NAMES_LIST_MAX_LEN] = {0, };
+static char dns_opt_cache_kv_key[] = "/kv/dns_opt_cache_key";
+static dns_opt_cache_t dns_opt_cache;
+static bool dns_opt_cache_dirty = false;
+static bool dns_opt_mesh_started = false;
+static bool dns_opt_refresh_postponed = false;
+static uint64_t dns_opt_ready_time = 0;
+static uint64_t dns_opt_cache_saved_time = 0;
+static network_dns_opt_stats_t dns_opt_stats;
+// Upper bounds of the resolution latency histogram buckets in milliseconds, last bucket is unbounded
+static const uint32_t dns_opt_latency_buckets[NETWORK_DNS_OPT_LATENCY_BUCKETS - 1] = {50, 100, 250, 500, 1000, 2000, 5000};
 
-static int parse_address(uint8_t *raw_addr, int raw_addr_size, char **parsed_addr)
-{
-    int size_index;
-    int end_index = -1;
-    int start_index = -1;
-    int parsed_addr_size = 0;
+static void dns_opt_refresh_due(void);
+APP_EVENT_SITE(dns_opt_refresh_site, dns_opt_refresh_due);
 
-    for (size_index = 0; size_index < raw_addr_size; size_index++) {
-        if (raw_addr[size_index] == ':') {
-            end_index = size_index;
+static dns_opt_entry_t *dns_opt_entry_find(const char *name, size_t name_len)
+{
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (strlen(dns_opt_entries[i].name) == name_len && strncmp(dns_opt_entries[i].name, name, name_len) == 0) {
+            return &dns_opt_entries[i];
         }
     }
-    if (end_index == -1) {
-        tr_err("LWM2M Server name is not valid");
-        return -1;
-    } else {
-        for (size_index = 0; size_index < end_index; size_index++) {
-            if (raw_addr[size_index] == '/') {
-                start_index = size_index;
-            }
+    return NULL;
+}
+
+static bool dns_opt_is_ip_literal(const char *name, size_t name_len)
+{
+    char address[NSAPI_IPv6_SIZE];
+    SocketAddress socket_address;
+
+    if (name_len >= sizeof(address)) {
+        return false;
+    }
+    memcpy(address, name, name_len);
+    address[name_len] = '\0';
+    return socket_address.set_ip_address(address);
+}
+
+static void dns_opt_entry_add(const char *name, size_t name_len, dns_opt_source_t source)
+{
+    dns_opt_entry_t *entry;
+
+    if (name_len == 0) {
+        return;
+    }
+    if (name_len >= DNS_OPT_NAME_MAX_LEN) {
+        tr_err("Host name %.*s is too long", (int)name_len, name);
+        return;
+    }
+
+    if (dns_opt_is_ip_literal(name, name_len)) {
+        tr_debug("%.*s is an IP address, nothing to resolve", (int)name_len, name);
+        return;
+    }
+
+    entry = dns_opt_entry_find(name, name_len);
+    if (entry != NULL) {
+        // Already resolved, keep the original source so that KCM names are never removed
+        return;
+    }
+
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] == '\0') {
+            entry = &dns_opt_entries[i];
+            break;
         }
-        if (start_index == -1) {
-            tr_err("LWM2M Server name is not valid");
-            return -1;
-        } else {
-            start_index++; /* Pointing to the next character of '/' */
-            parsed_addr_size = end_index - start_index;
-            if (*parsed_addr == NULL) {
-                *parsed_addr = (char *)malloc(parsed_addr_size + 1); /* Adding room for null character */
-            }
-            if (*parsed_addr == NULL) {
-                tr_err("Could not allocate memory to store URL");
-                return -1;
-            }
-            memcpy(*parsed_addr, raw_addr + start_index, parsed_addr_size);
-            /* parsed_addr is a string, need to terminate with null character */
-            *(*parsed_addr + parsed_addr_size) = '\0';
+    }
+    if (entry == NULL) {
+        tr_warn("DNS optimization table full, %.*s is not resolved", (int)name_len, name);
+        return;
+    }
+
+    memcpy(entry->name, name, name_len);
+    entry->name[name_len] = '\0';
+    entry->source = source;
+    entry->next_refresh = 0;
+    entry->retry_timeout = DNS_OPT_RETRY_TIMEOUT;
+    entry->published = false;
+    entry->resolved = false;
+    entry->resolved_time = 0;
+    entry->refreshed_time = 0;
+    tr_debug("DNS optimization added %s", entry->name);
+}
+
+static void dns_opt_entry_remove(dns_opt_entry_t *entry)
+{
+    tr_debug("DNS optimization removed %s", entry->name);
+    if (entry->published && ws_br != NULL) {
+        // NULL address removes the answer from the Wi-SUN network
+        if (ws_br->set_dns_query_result(NULL, entry->name) != MESH_ERROR_NONE) {
+            tr_warn("Could not remove DNS query result for %s", entry->name);
         }
     }
-    return 0;
+    if (entry->resolved) {
+        dns_opt_cache_dirty = true;
+    }
+    if (entry->query_pending) {
+        network_dns_resolver_cancel(entry->query_id);
+        entry->query_pending = false;
+    }
+    entry->name[0] = '\0';
+    entry->source = DNS_OPT_SOURCE_NONE;
+    entry->published = false;
+    entry->resolved = false;
 }
 
-static void get_server_name(void)
+/* Returns the next name of a comma separated list, false at the end of the list */
+static bool dns_opt_list_next(const char **list, const char **name, size_t *name_len)
 {
-    const int max_size = 256;
-    size_t real_size = 0;
-    uint8_t *buffer = (uint8_t *)malloc(max_size);
+    const char *start = *list;
+    const char *end;
 
-    if (buffer == NULL) {
-        tr_err("Could not allocate memory to read URLs");
-        return;
+    while (*start == ' ' || *start == ',') {
+        start++;
+    }
+    if (*start == '\0') {
+        return false;
     }
 
-    if (ccs_get_item(g_fcc_bootstrap_server_uri_name, buffer, max_size, &real_size, CCS_CONFIG_ITEM) == CCS_STATUS_SUCCESS) {
-        if (parse_address(buffer, real_size, &bootstrap_server_name) == 0) {
-            tr_debug("Bootstrap Server Name: %s", bootstrap_server_name);
-        } else {
-            tr_err("Could not parse Bootstrap server address");
+    end = start;
+    while (*end != '\0' && *end != ',') {
+        end++;
+    }
+    *list = end;
+
+    while (end > start && *(end - 1) == ' ') {
+        end--;
+    }
+    *name = start;
+    *name_len = end - start;
+    return true;
+}
+
+static bool dns_opt_list_contains(const char *list, const char *name)
+{
+    const char *list_name;
+    size_t list_name_len;
+
+    while (dns_opt_list_next(&list, &list_name, &list_name_len)) {
+        if (list_name_len == strlen(name) && strncmp(list_name, name, list_name_len) == 0) {
+            return true;
         }
+    }
+    return false;
+}
+
+static void dns_opt_entries_add_list(const char *list, dns_opt_source_t source)
+{
+    const char *name;
+    size_t name_len;
+
+    while (dns_opt_list_next(&list, &name, &name_len)) {
+        dns_opt_entry_add(name, name_len, source);
+    }
+}
+
+static void get_server_name(void)
+{
+    char server_name[DNS_OPT_NAME_MAX_LEN];
+
+    if (network_dns_uri_host_get(g_fcc_bootstrap_server_uri_name, server_name, sizeof(server_name)) == 0) {
+        tr_debug("Bootstrap Server Name: %s", server_name);
+        dns_opt_entry_add(server_name, strlen(server_name), DNS_OPT_SOURCE_KCM);
     } else {
-        tr_err("ccs_get_item Failed to get Bootstrap Server Name");
+        tr_err("Could not get Bootstrap server address");
     }
 
-    if (ccs_get_item(g_fcc_lwm2m_server_uri_name, buffer, max_size, &real_size, CCS_CONFIG_ITEM) == CCS_STATUS_SUCCESS) {
-        if (parse_address(buffer, real_size, &lwm2m_server_name) == 0) {
-            tr_debug("LWM2M Server Name: %s", lwm2m_server_name);
-        } else {
-            tr_err("Could not parse LWM2M server address");
-        }
+    if (network_dns_uri_host_get(g_fcc_lwm2m_server_uri_name, server_name, sizeof(server_name)) == 0) {
+        tr_debug("LWM2M Server Name: %s", server_name);
+        dns_opt_entry_add(server_name, strlen(server_name), DNS_OPT_SOURCE_KCM);
     } else {
-        tr_err("ccs_get_item Failed to get LWM2M Server Name");
+        tr_err("Could not get LWM2M server address");
     }
+}
 
-    free(buffer);
+static uint64_t dns_opt_time_ms(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    return Kernel::Clock::now().time_since_epoch().count();
+#else
+    return Kernel::get_ms_count();
+#endif
 }
 
-void network_dns_opt_configure(void *wisun_br, void *backbone_iface)
+static uint32_t dns_opt_jitter(uint32_t interval)
 {
-    ws_br = (WisunBorderRouter *)wisun_br;
-    backbone_interface = (NetworkInterface *)backbone_iface;
-    get_server_name();
-    if (backbone_interface->get_interface_name(network_interface_name) == NULL) {
-        tr_err("Could not get Network Interface Name");
+    uint32_t jitter_range = interval / 100 * DNS_OPT_JITTER_PERCENT;
+
+    if (jitter_range == 0) {
+        return 0;
     }
+    return randLIB_get_32bit() % jitter_range;
 }
 
-void bootstrap_addr_cb(nsapi_error_t result, SocketAddress *address)
+static time_t dns_opt_wall_clock(void)
 {
+    time_t now = time(NULL);
+
+    return (now >= DNS_OPT_VALID_TIME) ? now : 0;
+}
+
+/* Sets the answer to the border router, before mesh start the answer is kept for dns_opt_mesh_started */
+static bool dns_opt_publish(dns_opt_entry_t *entry)
+{
+    if (!dns_opt_mesh_started) {
+        return true;
+    }
+
     if (ws_br == NULL) {
         tr_err("Border router interface is NULL");
+        return false;
+    }
+
+    if (ws_br->set_dns_query_result(&entry->address, entry->name) != MESH_ERROR_NONE) {
+        tr_err("Could not set DNS query result for %s", entry->name);
+        dns_opt_stats.publish_failures++;
+        entry->published = false;
+    } else {
+        tr_debug("Setting DNS Query Result for %s: SUCCESS", entry->name);
+        dns_opt_stats.publishes++;
+        entry->published = true;
+    }
+    return entry->published;
+}
+
+/* Records the time when every name has been resolved through the backhaul for the first time */
+static void dns_opt_ready_check(void)
+{
+    if (dns_opt_ready_time != 0) {
         return;
     }
 
-    if (result != NSAPI_ERROR_OK) {
-        tr_warn("Could not resolve Bootstrap Server URL");
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] != '\0' && dns_opt_entries[i].refreshed_time == 0) {
+            return;
+        }
+    }
+
+    dns_opt_ready_time = dns_opt_time_ms();
+    tr_info("DNS optimization answers ready at %" PRIu64 " ms", dns_opt_ready_time);
+}
+
+static void dns_opt_cache_save(void)
+{
+    dns_opt_cache_t &cache = dns_opt_cache;
+    int kv_status;
+
+    memset(&cache, 0, sizeof(cache));
+    cache.version = DNS_OPT_CACHE_VERSION;
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] == '\0' || !dns_opt_entries[i].resolved) {
+            continue;
+        }
+        dns_opt_cache_record_t *record = &cache.records[cache.count++];
+        strcpy(record->name, dns_opt_entries[i].name);
+        memcpy(record->address, dns_opt_entries[i].address.get_ip_bytes(), NSAPI_IPv6_BYTES);
+        record->ttl = dns_opt_entries[i].ttl;
+        record->resolved_time = dns_opt_entries[i].resolved_time;
+    }
+
+    // Only the used records are stored
+    kv_status = kv_set(dns_opt_cache_kv_key, &cache, offsetof(dns_opt_cache_t, records) + cache.count * sizeof(dns_opt_cache_record_t), 0);
+    if (kv_status != MBED_SUCCESS) {
+        tr_warn("Could not set DNS Optimization Cache into KVStore, Error: %d", MBED_GET_ERROR_CODE(kv_status));
         return;
     }
+    tr_debug("DNS Optimization Cache stored into KVStore, %" PRIu8 " records", cache.count);
+    dns_opt_cache_dirty = false;
+    dns_opt_cache_saved_time = dns_opt_time_ms();
+}
 
-    tr_debug("Resolved Bootstrap Server Name: %s, IP: %s", bootstrap_server_name, address->get_ip_address());
-    if (ws_br->set_dns_query_result(address, bootstrap_server_name) != MESH_ERROR_NONE) {
-        tr_err("Could not set DNS query result for Bootstrap server");
-    } else {
-        tr_debug("Setting DNS Query Result for Bootstrap server: SUCCESS");
+/* Restores answers stored before reboot to the matching table entries */
+static void dns_opt_cache_load(void)
+{
+    dns_opt_cache_t &cache = dns_opt_cache;
+    size_t actual_size = 0;
+    time_t now = dns_opt_wall_clock();
+
+    if (kv_get(dns_opt_cache_kv_key, &cache, sizeof(cache), &actual_size) != MBED_SUCCESS) {
+        tr_debug("No DNS Optimization Cache in KVStore");
+        return;
+    }
+    if (actual_size < offsetof(dns_opt_cache_t, records) || cache.version != DNS_OPT_CACHE_VERSION ||
+            cache.count > DNS_OPT_NAMES_MAX || actual_size < offsetof(dns_opt_cache_t, records) + cache.count * sizeof(dns_opt_cache_record_t)) {
+        tr_warn("DNS Optimization Cache in KVStore is not valid");
+        return;
+    }
+
+    for (uint8_t i = 0; i < cache.count; i++) {
+        dns_opt_cache_record_t *record = &cache.records[i];
+        record->name[DNS_OPT_NAME_MAX_LEN - 1] = '\0';
+
+        dns_opt_entry_t *entry = dns_opt_entry_find(record->name, strlen(record->name));
+        if (entry == NULL || entry->resolved) {
+            continue;
+        }
+
+        // Without wall clock the age is not known, better to use the answer than nothing
+        if (now != 0 && record->resolved_time != 0) {
+            int64_t age = (int64_t)now - record->resolved_time;
+            if (age > DNS_OPT_CACHE_MAX_AGE || age > record->ttl) {
+                tr_info("Cached answer for %s is too old (%" PRId64 " s, TTL %" PRIu32 " s)", record->name, age, record->ttl);
+                continue;
+            }
+            tr_info("Restored %s from cache, age %" PRId64 " s TTL %" PRIu32 " s", record->name, age, record->ttl);
+        } else {
+            tr_info("Restored %s from cache, age unknown TTL %" PRIu32 " s", record->name, record->ttl);
+        }
+
+        entry->address.set_ip_bytes(record->address, NSAPI_IPv6);
+        entry->resolved_time = (time_t)record->resolved_time;
+        entry->ttl = record->ttl;
+        entry->resolved = true;
+        dns_opt_publish(entry);
     }
 }
 
-void lwm2m_addr_cb(nsapi_error_t result, SocketAddress *address)
+/* Arms the event queue for the entry that needs to be refreshed first */
+static void dns_opt_schedule(void)
 {
-    if (ws_br == NULL) {
-        tr_err("Border router interface is NULL");
+    uint64_t now = dns_opt_time_ms();
+    uint64_t next_refresh = UINT64_MAX;
+    uint32_t delay;
+
+    if (dns_opt_event_id != 0) {
+        dns_opt_queue->cancel(dns_opt_event_id);
+        dns_opt_event_id = 0;
+    }
+
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] == '\0' || dns_opt_entries[i].query_pending) {
+            continue;
+        }
+        if (dns_opt_entries[i].next_refresh < next_refresh) {
+            next_refresh = dns_opt_entries[i].next_refresh;
+        }
+    }
+
+    if (next_refresh == UINT64_MAX) {
         return;
     }
 
-    if (result != NSAPI_ERROR_OK) {
-        tr_warn("Could not resolve LWM2M Server URL");
+    delay = (next_refresh > now) ? (uint32_t)(next_refresh - now) : 0;
+    dns_opt_event_id = app_event_call_in(dns_opt_queue, &dns_opt_refresh_site, delay);
+    if (dns_opt_event_id == 0) {
+        tr_err("Could not schedule DNS refresh");
         return;
     }
+    tr_info("Next DNS refresh in %" PRIu32 " seconds", delay / 1000);
+}
 
-    tr_debug("Resolved LWM2M Server Name: %s, IP: %s", lwm2m_server_name, address->get_ip_address());
-    if (ws_br->set_dns_query_result(address, lwm2m_server_name) != MESH_ERROR_NONE) {
-        tr_err("Could not set DNS query result for LWM2M server");
+static void dns_opt_retry(dns_opt_entry_t *entry)
+{
+    entry->next_refresh = dns_opt_time_ms() + entry->retry_timeout - dns_opt_jitter(entry->retry_timeout);
+    tr_warn("Retrying %s in %" PRIu32 " seconds", entry->name, entry->retry_timeout / 1000);
+
+    // Exponential backoff, reset on the next successful resolution
+    entry->retry_timeout *= 2;
+    if (entry->retry_timeout > DNS_OPT_RETRY_TIMEOUT_MAX) {
+        entry->retry_timeout = DNS_OPT_RETRY_TIMEOUT_MAX;
+    }
+}
+
+static void dns_opt_latency_record(uint32_t latency)
+{
+    uint8_t bucket = 0;
+
+    while (bucket < NETWORK_DNS_OPT_LATENCY_BUCKETS - 1 && latency >= dns_opt_latency_buckets[bucket]) {
+        bucket++;
+    }
+    dns_opt_stats.latency_histogram[bucket]++;
+}
+
+/* Refresh interval of the answer in milliseconds, the TTL capped by the configured TTL */
+static uint32_t dns_opt_refresh_interval(uint32_t ttl)
+{
+    uint32_t interval = DNS_OPT_RECORD_TTL;
+
+    if (ttl < interval / 1000) {
+        interval = ttl * 1000;
+    }
+    if (interval < DNS_OPT_REFRESH_MIN_TIME) {
+        interval = DNS_OPT_REFRESH_MIN_TIME;
+    }
+    return interval;
+}
+
+static void dns_opt_addr_cb(void *context, nsapi_error_t result, SocketAddress *address, uint32_t ttl)
+{
+    dns_opt_entry_t *entry = (dns_opt_entry_t *)context;
+    bool first_answer = false;
+
+    entry->query_pending = false;
+
+    if (result < NSAPI_ERROR_OK || address == NULL) {
+        tr_warn("Could not resolve %s", entry->name);
+        dns_opt_stats.failures++;
+        dns_opt_retry(entry);
     } else {
-        tr_debug("Setting DNS Query Result for LWM2M server: SUCCESS");
+        dns_opt_stats.resolutions++;
+        dns_opt_latency_record((uint32_t)(dns_opt_time_ms() - entry->query_time));
+        tr_debug("Resolved Name: %s, IP: %s, TTL: %" PRIu32, entry->name, address->get_ip_address(), ttl);
+        if (!entry->resolved || entry->address != *address) {
+            dns_opt_cache_dirty = true;
+        }
+        first_answer = !entry->resolved;
+        entry->address = *address;
+        entry->resolved_time = dns_opt_wall_clock();
+        entry->ttl = ttl;
+        entry->resolved = true;
+        entry->refreshed_time = dns_opt_time_ms();
+        if (dns_opt_publish(entry)) {
+            uint32_t interval = dns_opt_refresh_interval(ttl);
+            dns_opt_ready_check();
+            entry->retry_timeout = DNS_OPT_RETRY_TIMEOUT;
+            entry->next_refresh = dns_opt_time_ms() + interval - dns_opt_jitter(interval);
+        } else {
+            dns_opt_retry(entry);
+        }
     }
+
+    // First answer of a name is saved at once, address rotations are saved with the next rate limited write
+    uint64_t since_save = dns_opt_time_ms() - dns_opt_cache_saved_time;
+    if ((dns_opt_cache_dirty && (first_answer || since_save >= DNS_OPT_CACHE_SAVE_MIN_INTERVAL)) ||
+            since_save >= DNS_OPT_CACHE_SAVE_INTERVAL) {
+        dns_opt_cache_save();
+    }
+
+    dns_opt_schedule();
 }
 
-void network_dns_opt_query_set(void)
+static void dns_opt_query(dns_opt_entry_t *entry)
+{
+    int ret_val;
+
+    // Resolver joins the query if the same name is already being resolved
+    ret_val = network_dns_resolver_query(entry->name, dns_opt_addr_cb, entry);
+    if (ret_val < 0) {
+        tr_err("Could not resolve Address for %s Error: %d", entry->name, ret_val);
+        dns_opt_stats.failures++;
+        dns_opt_retry(entry);
+        return;
+    }
+    entry->query_id = ret_val;
+    entry->query_time = dns_opt_time_ms();
+    entry->query_pending = true;
+}
+
+static void dns_opt_refresh_due(void)
+{
+    uint64_t now = dns_opt_time_ms();
+
+    dns_opt_event_id = 0;
+
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] == '\0' || dns_opt_entries[i].query_pending) {
+            continue;
+        }
+        if (dns_opt_entries[i].next_refresh > now) {
+            continue;
+        }
+        if (dns_opt_refresh_postponed && dns_opt_entries[i].refreshed_time != 0) {
+            // Published answer stays in use, names without an answer are still resolved
+            dns_opt_entries[i].next_refresh = now + DNS_OPT_POSTPONE_TIME;
+            continue;
+        }
+        dns_opt_query(&dns_opt_entries[i]);
+    }
+
+    dns_opt_schedule();
+}
+
+/* Synchronizes resource originated table entries with dns_opt_resource_names */
+static void dns_opt_resource_names_update(void)
+{
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].source != DNS_OPT_SOURCE_RESOURCE) {
+            continue;
+        }
+
+        if (!dns_opt_list_contains(dns_opt_resource_names, dns_opt_entries[i].name)) {
+            dns_opt_entry_remove(&dns_opt_entries[i]);
+        }
+    }
+
+    dns_opt_entries_add_list(dns_opt_resource_names, DNS_OPT_SOURCE_RESOURCE);
+}
+
+void network_dns_opt_configure(void *wisun_br, void *backbone_iface)
 {
-    nsapi_value_or_error_t ret_val = NSAPI_ERROR_OK;
+    ws_br = (WisunBorderRouter *)wisun_br;
+    backbone_interface = (NetworkInterface *)backbone_iface;
+    dns_opt_queue = mbed_event_queue();
+
+    // Table is filled in priority order, Pelion servers first
+    get_server_name();
+#ifdef MBED_CONF_APP_WISUN_NETWORK_DNS_NAMES
+    dns_opt_entries_add_list(MBED_CONF_APP_WISUN_NETWORK_DNS_NAMES, DNS_OPT_SOURCE_CONFIG);
+#endif
+    dns_opt_resource_names_update();
 
+    // Publish the last good answers until the backhaul resolver answers
+    dns_opt_cache_load();
+
+    // Queries are raced on the backhaul DNS servers
+    if (network_dns_resolver_init(backbone_interface) != 0) {
+        tr_err("Could not start DNS resolver");
+    }
+}
+
+void network_dns_opt_query_set(void)
+{
     if (backbone_interface == NULL) {
         tr_err("Backbone Interface is NULL");
         return;
     }
 
-    ret_val = backbone_interface->gethostbyname_async((const char *)bootstrap_server_name, bootstrap_addr_cb, NSAPI_IPv6, network_interface_name);
-    if (ret_val < NSAPI_ERROR_OK) {
-        tr_err("Could not resolve Bootstrap Server Address for %s Error: %d", bootstrap_server_name, ret_val);
+    // Refresh all names now, the scheduler takes over from the results
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        dns_opt_entries[i].next_refresh = 0;
+    }
+    dns_opt_refresh_due();
+}
+
+void network_dns_opt_names_set(const char *names)
+{
+    if (strlen(names) >= sizeof(dns_opt_resource_names)) {
+        tr_warn("DNS optimization name list is too long, truncated");
+    }
+    strncpy(dns_opt_resource_names, names, sizeof(dns_opt_resource_names) - 1);
+    dns_opt_resource_names[sizeof(dns_opt_resource_names) - 1] = '\0';
+
+    // Before configuration the list is only stored, it is applied when configured
+    if (backbone_interface == NULL) {
+        return;
     }
 
-    ret_val = backbone_interface->gethostbyname_async((const char *)lwm2m_server_name, lwm2m_addr_cb, NSAPI_IPv6, network_interface_name);
-    if (ret_val < NSAPI_ERROR_OK) {
-        tr_err("Could not resolve LWM2M Server Address for %s Error: %d", lwm2m_server_name, ret_val);
+    dns_opt_resource_names_update();
+    dns_opt_refresh_due();
+}
+
+void network_dns_opt_mesh_started(void)
+{
+    uint64_t now = dns_opt_time_ms();
+
+    dns_opt_mesh_started = true;
+
+    // Publish answers resolved or restored before the Wi-SUN network was started
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        if (dns_opt_entries[i].name[0] != '\0' && dns_opt_entries[i].resolved) {
+            dns_opt_publish(&dns_opt_entries[i]);
+        }
+    }
+
+    if (dns_opt_ready_time != 0) {
+        tr_info("DNS optimization answers ready %" PRIu64 " ms before mesh start at %" PRIu64 " ms", now - dns_opt_ready_time, now);
+    } else {
+        tr_info("DNS optimization answers not ready at mesh start at %" PRIu64 " ms", now);
+    }
+}
+
+void network_dns_opt_refresh_postpone(bool postpone)
+{
+    dns_opt_refresh_postponed = postpone;
+}
+
+int32_t network_dns_opt_next_refresh(void)
+{
+    if (dns_opt_queue == NULL || dns_opt_event_id == 0) {
+        return -1;
+    }
+    return dns_opt_queue->time_left(dns_opt_event_id);
+}
+
+void network_dns_opt_stats_get(network_dns_opt_stats_t *stats)
+{
+    *stats = dns_opt_stats;
+}
+
+int network_dns_opt_answer_ages_get(char *buffer, size_t buffer_size)
+{
+    uint64_t now = dns_opt_time_ms();
+    time_t wall_clock = dns_opt_wall_clock();
+    size_t length = 0;
+
+    buffer[0] = '\0';
+    for (size_t i = 0; i < DNS_OPT_NAMES_MAX; i++) {
+        dns_opt_entry_t *entry = &dns_opt_entries[i];
+        int64_t age = -1;
+        int ret;
+
+        if (entry->name[0] == '\0') {
+            continue;
+        }
+        if (entry->published && entry->refreshed_time != 0) {
+            age = (int64_t)((now - entry->refreshed_time) / 1000);
+        } else if (entry->published && wall_clock != 0 && entry->resolved_time != 0) {
+            // Restored from KVStore and not yet refreshed
+            age = (int64_t)wall_clock - entry->resolved_time;
+        }
+
+        ret = snprintf(buffer + length, buffer_size - length, "%s%s:%" PRId64, length ? "," : "", entry->name, age);
+        if (ret < 0 || (size_t)ret >= buffer_size - length) {
+            // Drop the partial name
+            buffer[length] = '\0';
+            return -1;
+        }
+        length += ret;
     }
+    return (int)length;
 }
 #endif  //defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
@@ -14,5 +14,35 @@
  * limitations under the License.
  */
 
+#ifndef NETWORK_DNS_OPTIMIZATION_H
+#define NETWORK_DNS_OPTIMIZATION_H
+
+#define NETWORK_DNS_OPT_LATENCY_BUCKETS 8
+
+typedef struct network_dns_opt_stats {
+    uint32_t resolutions;           // Answers received from the backhaul
+    uint32_t failures;              // Resolutions failed or could not be started
+    uint32_t publishes;             // Answers set to the border router
+    uint32_t publish_failures;
+    // Resolution latency, buckets end at 50, 100, 250, 500, 1000, 2000 and 5000 ms, last one is unbounded
+    uint32_t latency_histogram[NETWORK_DNS_OPT_LATENCY_BUCKETS];
+} network_dns_opt_stats_t;
+
 void network_dns_opt_configure(void *wisun_br, void *backbone_iface);
 void network_dns_opt_query_set(void);
+/* Publishes the answers resolved so far to the started border router */
+void network_dns_opt_mesh_started(void);
+/* Sets comma separated list of additional host names to pre-resolve, replaces the previous list */
+void network_dns_opt_names_set(const char *names);
+/* Postpones refreshes of the names that have an answer, e.g. when memory is low */
+void network_dns_opt_refresh_postpone(bool postpone);
+/* Milliseconds until the next scheduled DNS refresh, -1 if nothing is scheduled */
+int32_t network_dns_opt_next_refresh(void);
+void network_dns_opt_stats_get(network_dns_opt_stats_t *stats);
+/*
+ * Writes "name:age" list of the names, age is seconds since the published answer was resolved,
+ * -1 if no answer is published. Returns length or -1 if the buffer is too small.
+ */
+int network_dns_opt_answer_ages_get(char *buffer, size_t buffer_size);
+
+#endif /* NETWORK_DNS_OPTIMIZATION_H */
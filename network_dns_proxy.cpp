@@ -0,0 +1,668 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) && (MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY == 1)
+
+#include "mbed.h"
+#include "UDPSocket.h"
+#include "nsdynmemLIB.h"
+#include "randLIB.h"
+#include "mbed-trace/mbed_trace.h"
+#include "network_dns_proxy.h"
+#include "network_dns_msg.h"
+#include "app_event_queues.h"
+
+#define TRACE_GROUP "aDnP"  //Application DNS Proxy
+
+#ifdef MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY_CACHE_SIZE
+#define DNS_PROXY_CACHE_SIZE            MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY_CACHE_SIZE
+#else
+#define DNS_PROXY_CACHE_SIZE            32
+#endif
+
+#define DNS_PROXY_PENDING_MAX           8       // Outstanding upstream queries
+#define DNS_PROXY_WAITERS_MAX           16      // Queries from the Wi-SUN network joined to one upstream query
+#define DNS_PROXY_UPSTREAM_TIMEOUT      2000    // Milliseconds
+#define DNS_PROXY_UPSTREAM_RETRIES      2
+#define DNS_PROXY_TTL_MAX               24*60*60    // Seconds
+#define DNS_PROXY_NEGATIVE_TTL          60          // Seconds, used when there is no SOA record
+#define DNS_PROXY_NEGATIVE_TTL_MAX      5*60        // Seconds
+#define DNS_PROXY_UPSTREAM_PORT_QUERIES 16          // Upstream queries before the source port is changed
+#define DNS_PROXY_UPSTREAM_PORT_MIN     49152       // Dynamic port range of the upstream source port
+#define DNS_PROXY_UPSTREAM_PORT_MAX     65535
+#define DNS_PROXY_UPSTREAM_BIND_ATTEMPTS 4
+
+#define DNS_PORT                        53
+#define DNS_MSG_MAX_SIZE                512
+#define DNS_HEADER_SIZE                 NETWORK_DNS_MSG_HEADER_SIZE
+
+#define DNS_FLAGS_QR                    0x8000
+#define DNS_FLAGS_OPCODE                0x7800
+#define DNS_FLAGS_TC                    0x0200
+#define DNS_FLAGS_RD                    0x0100
+#define DNS_FLAGS_RA                    0x0080
+#define DNS_FLAGS_RCODE                 0x000F
+
+#define DNS_RCODE_NOERROR               0
+#define DNS_RCODE_SERVFAIL              2
+#define DNS_RCODE_NXDOMAIN              3
+
+// Cached response, data holds the question name followed by the response without the ID
+typedef struct dns_proxy_cache_entry {
+    uint8_t *data;
+    uint16_t qname_len;
+    uint16_t qtype;
+    uint16_t qclass;
+    uint16_t response_len;
+    uint64_t stored_time;       // Milliseconds
+    uint64_t expiry_time;       // Milliseconds
+    uint64_t last_used;         // Milliseconds, for LRU replacement
+    bool negative;
+} dns_proxy_cache_entry_t;
+
+typedef struct dns_proxy_waiter {
+    SocketAddress address;
+    uint16_t id;
+} dns_proxy_waiter_t;
+
+typedef struct dns_proxy_pending {
+    network_dns_msg_question_t question;
+    dns_proxy_waiter_t waiters[DNS_PROXY_WAITERS_MAX];
+    uint8_t waiters_count;
+    uint8_t retries;
+    uint16_t upstream_id;
+    SocketAddress server;       // Upstream server, responses from other sources are rejected
+    uint64_t sent_time;         // Milliseconds, first transmission
+    uint64_t timeout_time;      // Milliseconds
+    bool active;
+} dns_proxy_pending_t;
+
+static NetworkInterface *mesh_interface;
+static NetworkInterface *backbone_interface;
+static UDPSocket proxy_socket;
+static UDPSocket upstream_socket;
+static EventQueue *proxy_queue = NULL;
+static volatile bool proxy_rx_scheduled = false;
+static volatile bool upstream_rx_scheduled = false;
+static bool upstream_socket_open = false;
+static uint16_t upstream_port_queries = 0;
+static int proxy_timer_event_id = 0;
+static char backbone_interface_name[NSAPI_INTERFACE_NAME_MAX_SIZE];
+static uint8_t proxy_msg[DNS_MSG_MAX_SIZE];
+static dns_proxy_cache_entry_t proxy_cache[DNS_PROXY_CACHE_SIZE];
+// Answers are stored only to the first proxy_cache_limit entries
+static uint16_t proxy_cache_limit = DNS_PROXY_CACHE_SIZE;
+static dns_proxy_pending_t proxy_pending[DNS_PROXY_PENDING_MAX];
+static network_dns_proxy_stats_t proxy_stats;
+
+static void dns_proxy_timer_cb(void);
+static void dns_proxy_rx(void);
+static void dns_proxy_upstream_rx(void);
+static void dns_proxy_upstream_sigio(void);
+APP_EVENT_SITE(dns_proxy_timer_site, dns_proxy_timer_cb);
+APP_EVENT_SITE(dns_proxy_rx_site, dns_proxy_rx);
+APP_EVENT_SITE(dns_proxy_upstream_rx_site, dns_proxy_upstream_rx);
+
+static uint64_t dns_proxy_time_ms(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    return Kernel::Clock::now().time_since_epoch().count();
+#else
+    return Kernel::get_ms_count();
+#endif
+}
+
+static uint16_t dns_proxy_read16(const uint8_t *ptr)
+{
+    return (uint16_t)((ptr[0] << 8) | ptr[1]);
+}
+
+static void dns_proxy_write16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = (uint8_t)(value >> 8);
+    ptr[1] = (uint8_t)value;
+}
+
+static bool dns_proxy_question_match(const network_dns_msg_question_t *question, const uint8_t *qname, uint16_t qname_len, uint16_t qtype, uint16_t qclass)
+{
+    return question->qtype == qtype && question->qclass == qclass && question->qname_len == qname_len &&
+           memcmp(question->qname, qname, qname_len) == 0;
+}
+
+/* Walks the resource records of a response, answer and negative caching TTLs are limited for the cache */
+static int dns_proxy_rr_walk(uint8_t *msg, uint16_t msg_len, network_dns_msg_rr_info_t *info)
+{
+    if (network_dns_msg_rr_walk(msg, msg_len, 0, info) < 0) {
+        return -1;
+    }
+    if (info->answer_min_ttl > DNS_PROXY_TTL_MAX) {
+        info->answer_min_ttl = DNS_PROXY_TTL_MAX;
+    }
+    if (!info->soa_found) {
+        info->negative_ttl = DNS_PROXY_NEGATIVE_TTL;
+    }
+    if (info->negative_ttl > DNS_PROXY_NEGATIVE_TTL_MAX) {
+        info->negative_ttl = DNS_PROXY_NEGATIVE_TTL_MAX;
+    }
+    return 0;
+}
+
+static void dns_proxy_cache_entry_free(dns_proxy_cache_entry_t *entry)
+{
+    if (entry->data != NULL) {
+        ns_dyn_mem_free(entry->data);
+        proxy_stats.cache_entries--;
+    }
+    memset(entry, 0, sizeof(dns_proxy_cache_entry_t));
+}
+
+static dns_proxy_cache_entry_t *dns_proxy_cache_find(const network_dns_msg_question_t *question, uint64_t now)
+{
+    for (int i = 0; i < DNS_PROXY_CACHE_SIZE; i++) {
+        dns_proxy_cache_entry_t *entry = &proxy_cache[i];
+        if (entry->data == NULL || !dns_proxy_question_match(question, entry->data, entry->qname_len, entry->qtype, entry->qclass)) {
+            continue;
+        }
+        if (entry->expiry_time <= now) {
+            dns_proxy_cache_entry_free(entry);
+            return NULL;
+        }
+        return entry;
+    }
+    return NULL;
+}
+
+static void dns_proxy_cache_store(const network_dns_msg_question_t *question, const uint8_t *response, uint16_t response_len, uint32_t ttl, bool negative, uint64_t now)
+{
+    dns_proxy_cache_entry_t *entry = NULL;
+
+    if (ttl == 0 || proxy_cache_limit == 0) {
+        return;
+    }
+
+    // Replace the same question, an expired entry or the least recently used entry
+    for (int i = 0; i < proxy_cache_limit; i++) {
+        dns_proxy_cache_entry_t *candidate = &proxy_cache[i];
+        if (candidate->data == NULL || candidate->expiry_time <= now ||
+                dns_proxy_question_match(question, candidate->data, candidate->qname_len, candidate->qtype, candidate->qclass)) {
+            entry = candidate;
+            break;
+        }
+        if (entry == NULL || candidate->last_used < entry->last_used) {
+            entry = candidate;
+        }
+    }
+    dns_proxy_cache_entry_free(entry);
+
+    entry->data = (uint8_t *)ns_dyn_mem_alloc(question->qname_len + response_len);
+    if (entry->data == NULL) {
+        tr_warn("Out of memory for cache entry");
+        return;
+    }
+    proxy_stats.cache_entries++;
+
+    memcpy(entry->data, question->qname, question->qname_len);
+    memcpy(entry->data + question->qname_len, response, response_len);
+    entry->qname_len = question->qname_len;
+    entry->qtype = question->qtype;
+    entry->qclass = question->qclass;
+    entry->response_len = response_len;
+    entry->stored_time = now;
+    entry->expiry_time = now + (uint64_t)ttl * 1000;
+    entry->last_used = now;
+    entry->negative = negative;
+}
+
+/* Builds a query for the question to proxy_msg, returns length */
+static uint16_t dns_proxy_query_build(const network_dns_msg_question_t *question, uint16_t id)
+{
+    memset(proxy_msg, 0, DNS_HEADER_SIZE);
+    dns_proxy_write16(proxy_msg, id);
+    dns_proxy_write16(proxy_msg + 2, DNS_FLAGS_RD);
+    dns_proxy_write16(proxy_msg + 4, 1);
+    memcpy(proxy_msg + DNS_HEADER_SIZE, question->qname, question->qname_len);
+    dns_proxy_write16(proxy_msg + DNS_HEADER_SIZE + question->qname_len, question->qtype);
+    dns_proxy_write16(proxy_msg + DNS_HEADER_SIZE + question->qname_len + 2, question->qclass);
+    return DNS_HEADER_SIZE + question->qname_len + 4;
+}
+
+static void dns_proxy_reply(const SocketAddress &address, uint16_t id, uint8_t *msg, uint16_t msg_len)
+{
+    nsapi_size_or_error_t ret;
+
+    dns_proxy_write16(msg, id);
+    ret = proxy_socket.sendto(address, msg, msg_len);
+    if (ret < 0) {
+        tr_warn("Could not send DNS response to %s: %d", address.get_ip_address(), ret);
+    }
+}
+
+static void dns_proxy_servfail_reply(dns_proxy_pending_t *pending)
+{
+    uint16_t msg_len = dns_proxy_query_build(&pending->question, 0);
+
+    dns_proxy_write16(proxy_msg + 2, DNS_FLAGS_QR | DNS_FLAGS_RD | DNS_FLAGS_RA | DNS_RCODE_SERVFAIL);
+    for (uint8_t i = 0; i < pending->waiters_count; i++) {
+        dns_proxy_reply(pending->waiters[i].address, pending->waiters[i].id, proxy_msg, msg_len);
+    }
+}
+
+/*
+ * Opens the upstream socket on a random source port. Together with the random query ID this makes
+ * spoofed responses from the backhaul hard to match, the port is changed every few queries.
+ */
+static nsapi_error_t dns_proxy_upstream_open(void)
+{
+    nsapi_error_t ret = upstream_socket.open(backbone_interface);
+    if (ret != NSAPI_ERROR_OK) {
+        return ret;
+    }
+    for (int i = 0; i < DNS_PROXY_UPSTREAM_BIND_ATTEMPTS; i++) {
+        ret = upstream_socket.bind(randLIB_get_random_in_range(DNS_PROXY_UPSTREAM_PORT_MIN, DNS_PROXY_UPSTREAM_PORT_MAX));
+        if (ret == NSAPI_ERROR_OK) {
+            break;
+        }
+    }
+    if (ret != NSAPI_ERROR_OK) {
+        upstream_socket.close();
+        return ret;
+    }
+    upstream_socket.set_blocking(false);
+    upstream_socket.sigio(mbed::callback(dns_proxy_upstream_sigio));
+    upstream_socket_open = true;
+    upstream_port_queries = 0;
+    return NSAPI_ERROR_OK;
+}
+
+/* Changes the source port when no query is outstanding, responses to the old port would be lost */
+static void dns_proxy_upstream_rotate(void)
+{
+    if (upstream_socket_open && upstream_port_queries < DNS_PROXY_UPSTREAM_PORT_QUERIES) {
+        return;
+    }
+    for (int i = 0; i < DNS_PROXY_PENDING_MAX; i++) {
+        if (proxy_pending[i].active) {
+            return;
+        }
+    }
+
+    if (upstream_socket_open) {
+        upstream_socket.close();
+        upstream_socket_open = false;
+    }
+    nsapi_error_t ret = dns_proxy_upstream_open();
+    if (ret != NSAPI_ERROR_OK) {
+        tr_warn("Could not open DNS proxy upstream socket: %d", ret);
+    }
+}
+
+static int dns_proxy_upstream_send(dns_proxy_pending_t *pending)
+{
+    SocketAddress server;
+    uint16_t msg_len;
+    nsapi_size_or_error_t ret;
+
+    if (nsapi_create_stack(backbone_interface)->get_dns_server(0, &server, backbone_interface_name) != NSAPI_ERROR_OK) {
+        tr_warn("No DNS server on backhaul");
+        return -1;
+    }
+    server.set_port(DNS_PORT);
+
+    if (!upstream_socket_open) {
+        dns_proxy_upstream_rotate();
+        if (!upstream_socket_open) {
+            return -1;
+        }
+    }
+
+    msg_len = dns_proxy_query_build(&pending->question, pending->upstream_id);
+    ret = upstream_socket.sendto(server, proxy_msg, msg_len);
+    if (ret < 0) {
+        tr_warn("Could not send DNS query to %s: %d", server.get_ip_address(), ret);
+        return -1;
+    }
+
+    proxy_stats.upstream_queries++;
+    upstream_port_queries++;
+    pending->server = server;
+    pending->timeout_time = dns_proxy_time_ms() + DNS_PROXY_UPSTREAM_TIMEOUT;
+    return 0;
+}
+
+static void dns_proxy_timer_schedule(void)
+{
+    uint64_t next_timeout = UINT64_MAX;
+    uint64_t now = dns_proxy_time_ms();
+    uint32_t delay;
+
+    if (proxy_timer_event_id != 0) {
+        proxy_queue->cancel(proxy_timer_event_id);
+        proxy_timer_event_id = 0;
+    }
+
+    for (int i = 0; i < DNS_PROXY_PENDING_MAX; i++) {
+        if (proxy_pending[i].active && proxy_pending[i].timeout_time < next_timeout) {
+            next_timeout = proxy_pending[i].timeout_time;
+        }
+    }
+    if (next_timeout == UINT64_MAX) {
+        return;
+    }
+
+    delay = (next_timeout > now) ? (uint32_t)(next_timeout - now) : 0;
+    proxy_timer_event_id = app_event_call_in(proxy_queue, &dns_proxy_timer_site, delay);
+}
+
+static void dns_proxy_timer_cb(void)
+{
+    uint64_t now = dns_proxy_time_ms();
+
+    proxy_timer_event_id = 0;
+
+    for (int i = 0; i < DNS_PROXY_PENDING_MAX; i++) {
+        dns_proxy_pending_t *pending = &proxy_pending[i];
+        if (!pending->active || pending->timeout_time > now) {
+            continue;
+        }
+        if (pending->retries < DNS_PROXY_UPSTREAM_RETRIES && dns_proxy_upstream_send(pending) == 0) {
+            pending->retries++;
+            continue;
+        }
+        tr_warn("Upstream DNS query timed out");
+        proxy_stats.upstream_failures++;
+        dns_proxy_servfail_reply(pending);
+        pending->active = false;
+    }
+
+    dns_proxy_upstream_rotate();
+    dns_proxy_timer_schedule();
+}
+
+/* Joins the query to an outstanding upstream query of the same question or sends a new one */
+static void dns_proxy_forward(const network_dns_msg_question_t *question, const SocketAddress &address, uint16_t id)
+{
+    dns_proxy_pending_t *pending = NULL;
+    dns_proxy_pending_t *free_pending = NULL;
+
+    for (int i = 0; i < DNS_PROXY_PENDING_MAX; i++) {
+        if (!proxy_pending[i].active) {
+            if (free_pending == NULL) {
+                free_pending = &proxy_pending[i];
+            }
+            continue;
+        }
+        if (dns_proxy_question_match(question, proxy_pending[i].question.qname, proxy_pending[i].question.qname_len,
+                                     proxy_pending[i].question.qtype, proxy_pending[i].question.qclass)) {
+            pending = &proxy_pending[i];
+            break;
+        }
+    }
+
+    if (pending != NULL) {
+        if (pending->waiters_count >= DNS_PROXY_WAITERS_MAX) {
+            // Node retries and is answered from the cache
+            proxy_stats.dropped++;
+            return;
+        }
+        proxy_stats.coalesced++;
+        pending->waiters[pending->waiters_count].address = address;
+        pending->waiters[pending->waiters_count].id = id;
+        pending->waiters_count++;
+        return;
+    }
+
+    if (free_pending == NULL) {
+        proxy_stats.dropped++;
+        return;
+    }
+
+    pending = free_pending;
+    pending->question = *question;
+    pending->waiters[0].address = address;
+    pending->waiters[0].id = id;
+    pending->waiters_count = 1;
+    pending->retries = 0;
+    pending->upstream_id = (uint16_t)randLIB_get_32bit();
+    pending->sent_time = dns_proxy_time_ms();
+    if (dns_proxy_upstream_send(pending) < 0) {
+        pending->waiters_count = 1;
+        dns_proxy_servfail_reply(pending);
+        proxy_stats.upstream_failures++;
+        return;
+    }
+    pending->active = true;
+    dns_proxy_timer_schedule();
+}
+
+/* Accepts queries only from the Wi-SUN network, the proxy must not be an open resolver on backhaul */
+static bool dns_proxy_source_allowed(const SocketAddress &address)
+{
+    SocketAddress mesh_address;
+
+    if (mesh_interface->get_ip_address(&mesh_address) != NSAPI_ERROR_OK || mesh_address.get_ip_version() != NSAPI_IPv6 ||
+            address.get_ip_version() != NSAPI_IPv6) {
+        return false;
+    }
+    return memcmp(mesh_address.get_ip_bytes(), address.get_ip_bytes(), 8) == 0;
+}
+
+static void dns_proxy_query_handle(const SocketAddress &address, uint16_t msg_len)
+{
+    network_dns_msg_question_t question;
+    dns_proxy_cache_entry_t *entry;
+    uint64_t now = dns_proxy_time_ms();
+    uint16_t flags;
+    uint16_t id;
+
+    proxy_stats.queries++;
+
+    flags = dns_proxy_read16(proxy_msg + 2);
+    if (flags & (DNS_FLAGS_QR | DNS_FLAGS_OPCODE) || network_dns_msg_question_parse(proxy_msg, msg_len, &question) < 0) {
+        proxy_stats.dropped++;
+        return;
+    }
+    id = dns_proxy_read16(proxy_msg);
+
+    entry = dns_proxy_cache_find(&question, now);
+    if (entry == NULL) {
+        proxy_stats.cache_misses++;
+        dns_proxy_forward(&question, address, id);
+        return;
+    }
+
+    proxy_stats.cache_hits++;
+    if (entry->negative) {
+        proxy_stats.negative_hits++;
+    }
+    entry->last_used = now;
+
+    // TTLs are decreased by the time spent in cache
+    network_dns_msg_rr_info_t info;
+    memcpy(proxy_msg, entry->data + entry->qname_len, entry->response_len);
+    network_dns_msg_rr_walk(proxy_msg, entry->response_len, (uint32_t)((now - entry->stored_time) / 1000), &info);
+    dns_proxy_reply(address, id, proxy_msg, entry->response_len);
+}
+
+static void dns_proxy_response_handle(const SocketAddress &source, uint16_t msg_len)
+{
+    network_dns_msg_question_t question;
+    dns_proxy_pending_t *pending = NULL;
+    network_dns_msg_rr_info_t info;
+    uint64_t now = dns_proxy_time_ms();
+    uint16_t flags;
+    uint16_t id;
+    uint8_t rcode;
+
+    if (msg_len < DNS_HEADER_SIZE) {
+        return;
+    }
+    id = dns_proxy_read16(proxy_msg);
+    flags = dns_proxy_read16(proxy_msg + 2);
+    if (!(flags & DNS_FLAGS_QR) || network_dns_msg_question_parse(proxy_msg, msg_len, &question) < 0) {
+        return;
+    }
+
+    // Response must come from the server the query was sent to, otherwise any backhaul host could poison the cache
+    for (int i = 0; i < DNS_PROXY_PENDING_MAX; i++) {
+        if (proxy_pending[i].active && proxy_pending[i].upstream_id == id &&
+                proxy_pending[i].server == source && source.get_port() == DNS_PORT &&
+                dns_proxy_question_match(&question, proxy_pending[i].question.qname, proxy_pending[i].question.qname_len,
+                                         proxy_pending[i].question.qtype, proxy_pending[i].question.qclass)) {
+            pending = &proxy_pending[i];
+            break;
+        }
+    }
+    if (pending == NULL) {
+        tr_debug("Unexpected DNS response %" PRIu16 " from %s", id, source.get_ip_address());
+        return;
+    }
+
+    uint32_t latency = (uint32_t)(now - pending->sent_time);
+    proxy_stats.upstream_latency_avg = (proxy_stats.upstream_latency_avg == 0) ? latency : (proxy_stats.upstream_latency_avg * 7 + latency) / 8;
+    if (latency > proxy_stats.upstream_latency_max) {
+        proxy_stats.upstream_latency_max = latency;
+    }
+
+    rcode = flags & DNS_FLAGS_RCODE;
+    if (rcode != DNS_RCODE_NOERROR && rcode != DNS_RCODE_NXDOMAIN) {
+        proxy_stats.upstream_failures++;
+    } else if (!(flags & DNS_FLAGS_TC) && dns_proxy_rr_walk(proxy_msg, msg_len, &info) == 0) {
+        // NXDOMAIN and empty NOERROR answers are cached as negative answers
+        bool negative = (rcode == DNS_RCODE_NXDOMAIN || dns_proxy_read16(proxy_msg + 6) == 0);
+        dns_proxy_cache_store(&question, proxy_msg, msg_len, negative ? info.negative_ttl : info.answer_min_ttl, negative, now);
+    }
+
+    tr_debug("DNS response %" PRIu16 " rcode %" PRIu8 " in %" PRIu32 " ms to %" PRIu8 " queries", id, rcode, latency, pending->waiters_count);
+    for (uint8_t i = 0; i < pending->waiters_count; i++) {
+        dns_proxy_reply(pending->waiters[i].address, pending->waiters[i].id, proxy_msg, msg_len);
+    }
+    pending->active = false;
+    dns_proxy_upstream_rotate();
+    dns_proxy_timer_schedule();
+}
+
+static void dns_proxy_rx(void)
+{
+    SocketAddress address;
+    nsapi_size_or_error_t ret;
+
+    proxy_rx_scheduled = false;
+
+    while ((ret = proxy_socket.recvfrom(&address, proxy_msg, sizeof(proxy_msg))) >= 0) {
+        if (!dns_proxy_source_allowed(address)) {
+            proxy_stats.dropped++;
+            continue;
+        }
+        dns_proxy_query_handle(address, (uint16_t)ret);
+    }
+}
+
+static void dns_proxy_upstream_rx(void)
+{
+    SocketAddress address;
+    nsapi_size_or_error_t ret;
+
+    upstream_rx_scheduled = false;
+
+    while ((ret = upstream_socket.recvfrom(&address, proxy_msg, sizeof(proxy_msg))) >= 0) {
+        dns_proxy_response_handle(address, (uint16_t)ret);
+    }
+}
+
+// Socket events come from the stack thread, handling is done in the event queue
+static void dns_proxy_sigio(void)
+{
+    if (!core_util_atomic_exchange_bool(&proxy_rx_scheduled, true)) {
+        app_event_call(proxy_queue, &dns_proxy_rx_site);
+    }
+}
+
+static void dns_proxy_upstream_sigio(void)
+{
+    if (!core_util_atomic_exchange_bool(&upstream_rx_scheduled, true)) {
+        app_event_call(proxy_queue, &dns_proxy_upstream_rx_site);
+    }
+}
+
+int network_dns_proxy_start(void *mesh_iface, void *backbone_iface)
+{
+    nsapi_error_t ret;
+
+    if (proxy_queue != NULL) {
+        return 0;
+    }
+
+    mesh_interface = (NetworkInterface *)mesh_iface;
+    backbone_interface = (NetworkInterface *)backbone_iface;
+    proxy_queue = mbed_event_queue();
+
+    // Buffer size is NSAPI_INTERFACE_NAME_MAX_SIZE as required by get_interface_name()
+    if (backbone_interface->get_interface_name(backbone_interface_name) == NULL) {
+        tr_err("Could not get Network Interface Name");
+    }
+    backbone_interface_name[sizeof(backbone_interface_name) - 1] = '\0';
+
+    ret = proxy_socket.open(mesh_interface);
+    if (ret == NSAPI_ERROR_OK) {
+        ret = proxy_socket.bind(DNS_PORT);
+    }
+    if (ret != NSAPI_ERROR_OK) {
+        tr_err("Could not open DNS proxy socket: %d", ret);
+        proxy_queue = NULL;
+        return -1;
+    }
+    proxy_socket.set_blocking(false);
+    proxy_socket.sigio(mbed::callback(dns_proxy_sigio));
+
+    ret = dns_proxy_upstream_open();
+    if (ret != NSAPI_ERROR_OK) {
+        tr_err("Could not open DNS proxy upstream socket: %d", ret);
+        proxy_socket.close();
+        proxy_queue = NULL;
+        return -1;
+    }
+
+    tr_info("DNS proxy started, cache size %d", DNS_PROXY_CACHE_SIZE);
+    return 0;
+}
+
+void network_dns_proxy_stats_get(network_dns_proxy_stats_t *stats)
+{
+    *stats = proxy_stats;
+}
+
+void network_dns_proxy_cache_flush(void)
+{
+    for (int i = 0; i < DNS_PROXY_CACHE_SIZE; i++) {
+        dns_proxy_cache_entry_free(&proxy_cache[i]);
+    }
+}
+
+void network_dns_proxy_cache_limit_set(uint16_t limit)
+{
+    if (limit > DNS_PROXY_CACHE_SIZE) {
+        limit = DNS_PROXY_CACHE_SIZE;
+    }
+    for (int i = limit; i < DNS_PROXY_CACHE_SIZE; i++) {
+        dns_proxy_cache_entry_free(&proxy_cache[i]);
+    }
+    proxy_cache_limit = limit;
+}
+
+uint16_t network_dns_proxy_cache_size(void)
+{
+    return DNS_PROXY_CACHE_SIZE;
+}
+#endif  //defined(MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY) && (MBED_CONF_APP_WISUN_NETWORK_DNS_PROXY == 1)
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_DNS_PROXY_H
+#define NETWORK_DNS_PROXY_H
+
+typedef struct network_dns_proxy_stats {
+    uint32_t queries;               // Queries received from the Wi-SUN network
+    uint32_t cache_hits;            // Answered from cache, including negative answers
+    uint32_t negative_hits;         // Answered from cache with NXDOMAIN or no data
+    uint32_t cache_misses;          // Forwarded or joined to an outstanding upstream query
+    uint32_t coalesced;             // Misses joined to an outstanding upstream query
+    uint32_t dropped;               // Malformed queries or no room for the query
+    uint32_t upstream_queries;      // Queries sent to the backhaul DNS server, including retries
+    uint32_t upstream_failures;     // Upstream queries timed out or failed
+    uint32_t upstream_latency_avg;  // Milliseconds, moving average
+    uint32_t upstream_latency_max;  // Milliseconds
+    uint16_t cache_entries;
+} network_dns_proxy_stats_t;
+
+/* Starts DNS forwarder for queries from the Wi-SUN network, must be called from the event queue */
+int network_dns_proxy_start(void *mesh_iface, void *backbone_iface);
+void network_dns_proxy_stats_get(network_dns_proxy_stats_t *stats);
+/* Drops all cached answers */
+void network_dns_proxy_cache_flush(void);
+/* Limits the number of cached answers, answers above the limit are dropped */
+void network_dns_proxy_cache_limit_set(uint16_t limit);
+/* Configured maximum number of cached answers */
+uint16_t network_dns_proxy_cache_size(void);
+
+#endif /* NETWORK_DNS_PROXY_H */
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+
+#include "mbed.h"
+#include "UDPSocket.h"
+#include "randLIB.h"
+#include "mbed-trace/mbed_trace.h"
+#include "network_dns_resolver.h"
+#include "network_dns_msg.h"
+#include "app_event_queues.h"
+
+#define TRACE_GROUP "aDnR"  //Application DNS Resolver
+
+#define DNS_RESOLVER_QUERIES_MAX        8
+#define DNS_RESOLVER_WAITERS_MAX        4
+#define DNS_RESOLVER_ATTEMPTS_MAX       (DNS_RESOLVER_QUERIES_MAX * 2)
+#define DNS_RESOLVER_SERVERS_MAX        4       // Backhaul DNS servers tracked for latency
+#define DNS_RESOLVER_RACE_WIDTH         2       // Servers queried in parallel
+#define DNS_RESOLVER_TIMEOUT            3000    // Milliseconds
+#define DNS_RESOLVER_DEMOTE_FAILURES    3       // Consecutive failures before the server is demoted
+#define DNS_RESOLVER_DEMOTE_TIME        5*60*1000   // Milliseconds
+#define DNS_RESOLVER_NAME_MAX_LEN       128
+
+#define DNS_PORT                        53
+#define DNS_MSG_MAX_SIZE                512
+#define DNS_HEADER_SIZE                 NETWORK_DNS_MSG_HEADER_SIZE
+#define DNS_QNAME_MAX_SIZE              NETWORK_DNS_MSG_QNAME_MAX_SIZE
+#define DNS_FLAGS_QR                    0x8000
+#define DNS_FLAGS_RD                    0x0100
+#define DNS_FLAGS_RCODE                 0x000F
+#define DNS_RCODE_NOERROR               0
+#define DNS_RCODE_NXDOMAIN              3
+#define DNS_TYPE_AAAA                   28
+#define DNS_CLASS_IN                    1
+
+typedef struct dns_resolver_server {
+    SocketAddress address;      // Unspecified if the entry is free
+    uint32_t latency;           // Milliseconds, moving average, 0 if not measured
+    uint32_t answers;
+    uint32_t timeouts;
+    uint8_t failures;           // Consecutive timeouts or server failures
+    uint64_t demoted_until;     // Milliseconds, server is tried last until this
+    bool present;               // Server is in the current backhaul DNS server list
+} dns_resolver_server_t;
+
+typedef struct dns_resolver_waiter {
+    network_dns_resolver_cb_t cb;
+    void *context;
+    int id;
+} dns_resolver_waiter_t;
+
+typedef struct dns_resolver_query {
+    char name[DNS_RESOLVER_NAME_MAX_LEN];
+    dns_resolver_waiter_t waiters[DNS_RESOLVER_WAITERS_MAX];
+    uint8_t waiters_count;
+    uint8_t servers[DNS_RESOLVER_SERVERS_MAX];  // Server table indexes, fastest first
+    uint8_t servers_count;
+    uint8_t servers_used;
+    uint8_t attempts;           // Outstanding attempts
+    bool active;
+} dns_resolver_query_t;
+
+// Query sent to one server, kept after the race is decided to measure the latency of the loser
+typedef struct dns_resolver_attempt {
+    dns_resolver_query_t *query;    // NULL if the query has completed or was cancelled
+    uint8_t server;
+    uint16_t id;
+    uint64_t sent_time;             // Milliseconds
+    bool active;
+} dns_resolver_attempt_t;
+
+static NetworkInterface *backbone_interface;
+static char network_interface_name[NSAPI_INTERFACE_NAME_MAX_SIZE];
+static UDPSocket resolver_socket;
+static EventQueue *resolver_queue = NULL;
+static volatile bool resolver_rx_scheduled = false;
+static int resolver_timer_event_id = 0;
+static int resolver_query_id = 0;
+static uint8_t resolver_msg[DNS_MSG_MAX_SIZE];
+static dns_resolver_server_t resolver_servers[DNS_RESOLVER_SERVERS_MAX];
+static dns_resolver_query_t resolver_queries[DNS_RESOLVER_QUERIES_MAX];
+static dns_resolver_attempt_t resolver_attempts[DNS_RESOLVER_ATTEMPTS_MAX];
+
+static void dns_resolver_timer_cb(void);
+static void dns_resolver_rx(void);
+APP_EVENT_SITE(dns_resolver_timer_site, dns_resolver_timer_cb);
+APP_EVENT_SITE(dns_resolver_rx_site, dns_resolver_rx);
+
+static uint64_t dns_resolver_time_ms(void)
+{
+#if MBED_MAJOR_VERSION > 5
+    return Kernel::Clock::now().time_since_epoch().count();
+#else
+    return Kernel::get_ms_count();
+#endif
+}
+
+static uint16_t dns_resolver_read16(const uint8_t *ptr)
+{
+    return (uint16_t)((ptr[0] << 8) | ptr[1]);
+}
+
+static void dns_resolver_write16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = (uint8_t)(value >> 8);
+    ptr[1] = (uint8_t)value;
+}
+
+/* Builds AAAA query for the name to resolver_msg, returns length or 0 if the name is not valid */
+static uint16_t dns_resolver_query_build(const char *name, uint16_t id)
+{
+    uint16_t offset = DNS_HEADER_SIZE;
+
+    memset(resolver_msg, 0, DNS_HEADER_SIZE);
+    dns_resolver_write16(resolver_msg, id);
+    dns_resolver_write16(resolver_msg + 2, DNS_FLAGS_RD);
+    dns_resolver_write16(resolver_msg + 4, 1);
+
+    while (*name != '\0') {
+        const char *label_end = strchr(name, '.');
+        size_t label_len = label_end ? (size_t)(label_end - name) : strlen(name);
+
+        if (label_len == 0 || label_len > 63 || offset + label_len + 1 > DNS_HEADER_SIZE + DNS_QNAME_MAX_SIZE - 1) {
+            return 0;
+        }
+        resolver_msg[offset++] = (uint8_t)label_len;
+        memcpy(resolver_msg + offset, name, label_len);
+        offset += label_len;
+        name += label_len;
+        if (*name == '.') {
+            name++;
+        }
+    }
+    resolver_msg[offset++] = 0;
+
+    dns_resolver_write16(resolver_msg + offset, DNS_TYPE_AAAA);
+    dns_resolver_write16(resolver_msg + offset + 2, DNS_CLASS_IN);
+    return offset + 4;
+}
+
+/* Synchronizes the server table with the backhaul DNS servers, statistics of known servers are kept */
+static void dns_resolver_servers_update(void)
+{
+    NetworkStack *stack = nsapi_create_stack(backbone_interface);
+    SocketAddress address;
+    bool found[DNS_RESOLVER_SERVERS_MAX] = {false, };
+
+    for (int i = 0; i < DNS_RESOLVER_SERVERS_MAX; i++) {
+        resolver_servers[i].present = false;
+    }
+
+    for (int index = 0; index < DNS_RESOLVER_SERVERS_MAX; index++) {
+        if (stack->get_dns_server(index, &address, network_interface_name) != NSAPI_ERROR_OK) {
+            break;
+        }
+        for (int i = 0; i < DNS_RESOLVER_SERVERS_MAX; i++) {
+            if (resolver_servers[i].address == address) {
+                resolver_servers[i].present = true;
+                found[index] = true;
+                break;
+            }
+        }
+    }
+
+    // New servers replace the servers not in the list anymore
+    for (int index = 0; index < DNS_RESOLVER_SERVERS_MAX; index++) {
+        if (stack->get_dns_server(index, &address, network_interface_name) != NSAPI_ERROR_OK) {
+            break;
+        }
+        if (found[index]) {
+            continue;
+        }
+        for (int i = 0; i < DNS_RESOLVER_SERVERS_MAX; i++) {
+            if (!resolver_servers[i].present) {
+                resolver_servers[i].address = address;
+                resolver_servers[i].address.set_port(DNS_PORT);
+                resolver_servers[i].latency = 0;
+                resolver_servers[i].answers = 0;
+                resolver_servers[i].timeouts = 0;
+                resolver_servers[i].failures = 0;
+                resolver_servers[i].demoted_until = 0;
+                resolver_servers[i].present = true;
+                tr_info("DNS server %s", resolver_servers[i].address.get_ip_address());
+                break;
+            }
+        }
+    }
+}
+
+static bool dns_resolver_server_before(const dns_resolver_server_t *a, const dns_resolver_server_t *b, uint64_t now)
+{
+    bool a_demoted = a->demoted_until > now;
+    bool b_demoted = b->demoted_until > now;
+
+    if (a_demoted != b_demoted) {
+        return b_demoted;
+    }
+    return a->latency < b->latency;
+}
+
+/* Orders the present servers for the query, demoted servers last, then by latency */
+static void dns_resolver_servers_order(dns_resolver_query_t *query)
+{
+    uint64_t now = dns_resolver_time_ms();
+
+    query->servers_count = 0;
+    query->servers_used = 0;
+    for (uint8_t i = 0; i < DNS_RESOLVER_SERVERS_MAX; i++) {
+        if (!resolver_servers[i].present) {
+            continue;
+        }
+
+        // Insertion sort, servers without samples are tried first to measure them
+        uint8_t pos = query->servers_count;
+        while (pos > 0 && dns_resolver_server_before(&resolver_servers[i], &resolver_servers[query->servers[pos - 1]], now)) {
+            query->servers[pos] = query->servers[pos - 1];
+            pos--;
+        }
+        query->servers[pos] = i;
+        query->servers_count++;
+    }
+}
+
+static void dns_resolver_server_failure(dns_resolver_server_t *server, uint32_t latency)
+{
+    server->latency = (server->latency == 0) ? latency : (server->latency * 3 + latency) / 4;
+    if (++server->failures >= DNS_RESOLVER_DEMOTE_FAILURES && server->demoted_until <= dns_resolver_time_ms()) {
+        server->demoted_until = dns_resolver_time_ms() + DNS_RESOLVER_DEMOTE_TIME;
+        tr_warn("DNS server %s demoted after %" PRIu8 " failures", server->address.get_ip_address(), server->failures);
+    }
+}
+
+static void dns_resolver_timer_schedule(void)
+{
+    uint64_t next_timeout = UINT64_MAX;
+    uint64_t now = dns_resolver_time_ms();
+    uint32_t delay;
+
+    if (resolver_timer_event_id != 0) {
+        resolver_queue->cancel(resolver_timer_event_id);
+        resolver_timer_event_id = 0;
+    }
+
+    for (int i = 0; i < DNS_RESOLVER_ATTEMPTS_MAX; i++) {
+        if (resolver_attempts[i].active && resolver_attempts[i].sent_time + DNS_RESOLVER_TIMEOUT < next_timeout) {
+            next_timeout = resolver_attempts[i].sent_time + DNS_RESOLVER_TIMEOUT;
+        }
+    }
+    if (next_timeout == UINT64_MAX) {
+        return;
+    }
+
+    delay = (next_timeout > now) ? (uint32_t)(next_timeout - now) : 0;
+    resolver_timer_event_id = app_event_call_in(resolver_queue, &dns_resolver_timer_site, delay);
+}
+
+/* Sends the query to the next server in order, returns false if no server could be used */
+static bool dns_resolver_attempt_send(dns_resolver_query_t *query)
+{
+    while (query->servers_used < query->servers_count) {
+        dns_resolver_server_t *server = &resolver_servers[query->servers[query->servers_used]];
+        dns_resolver_attempt_t *attempt = NULL;
+        uint16_t msg_len;
+
+        for (int i = 0; i < DNS_RESOLVER_ATTEMPTS_MAX; i++) {
+            if (!resolver_attempts[i].active) {
+                attempt = &resolver_attempts[i];
+                break;
+            }
+        }
+        if (attempt == NULL) {
+            tr_warn("No free DNS attempt for %s", query->name);
+            return false;
+        }
+
+        attempt->id = (uint16_t)randLIB_get_32bit();
+        msg_len = dns_resolver_query_build(query->name, attempt->id);
+        if (msg_len == 0) {
+            tr_err("Host name %s is not valid", query->name);
+            return false;
+        }
+
+        attempt->server = query->servers[query->servers_used++];
+        if (resolver_socket.sendto(server->address, resolver_msg, msg_len) < 0) {
+            tr_warn("Could not send DNS query to %s", server->address.get_ip_address());
+            continue;
+        }
+        attempt->query = query;
+        attempt->sent_time = dns_resolver_time_ms();
+        attempt->active = true;
+        query->attempts++;
+        return true;
+    }
+    return false;
+}
+
+/* Reports the result to every waiter, attempts still outstanding become cancelled losers */
+static void dns_resolver_query_complete(dns_resolver_query_t *query, nsapi_error_t result, SocketAddress *address, uint32_t ttl)
+{
+    dns_resolver_waiter_t waiters[DNS_RESOLVER_WAITERS_MAX];
+    uint8_t waiters_count = query->waiters_count;
+
+    for (int i = 0; i < DNS_RESOLVER_ATTEMPTS_MAX; i++) {
+        if (resolver_attempts[i].query == query) {
+            resolver_attempts[i].query = NULL;
+        }
+    }
+
+    // Query is freed first so that callbacks can start new queries
+    memcpy(waiters, query->waiters, sizeof(waiters));
+    query->active = false;
+    query->waiters_count = 0;
+
+    for (uint8_t i = 0; i < waiters_count; i++) {
+        waiters[i].cb(waiters[i].context, result, address, ttl);
+    }
+}
+
+/* Called when an attempt of the query did not give an answer */
+static void dns_resolver_attempt_failed(dns_resolver_query_t *query, nsapi_error_t result)
+{
+    query->attempts--;
+    if (query->attempts > 0) {
+        // The other racer may still answer
+        return;
+    }
+    if (dns_resolver_attempt_send(query)) {
+        return;
+    }
+    tr_warn("Could not resolve %s from any DNS server", query->name);
+    dns_resolver_query_complete(query, result, NULL, 0);
+}
+
+static void dns_resolver_timer_cb(void)
+{
+    uint64_t now = dns_resolver_time_ms();
+
+    resolver_timer_event_id = 0;
+
+    for (int i = 0; i < DNS_RESOLVER_ATTEMPTS_MAX; i++) {
+        dns_resolver_attempt_t *attempt = &resolver_attempts[i];
+        if (!attempt->active || attempt->sent_time + DNS_RESOLVER_TIMEOUT > now) {
+            continue;
+        }
+        attempt->active = false;
+        resolver_servers[attempt->server].timeouts++;
+        dns_resolver_server_failure(&resolver_servers[attempt->server], DNS_RESOLVER_TIMEOUT);
+        if (attempt->query != NULL) {
+            dns_resolver_attempt_failed(attempt->query, NSAPI_ERROR_TIMEOUT);
+        }
+    }
+
+    dns_resolver_timer_schedule();
+}
+
+static void dns_resolver_response_handle(const SocketAddress &source, uint16_t msg_len)
+{
+    dns_resolver_attempt_t *attempt = NULL;
+    dns_resolver_server_t *server;
+    dns_resolver_query_t *query;
+    SocketAddress address;
+    uint8_t address_bytes[NETWORK_DNS_MSG_IPV6_SIZE];
+    uint32_t latency;
+    uint32_t ttl = 0;
+    uint16_t flags;
+    uint8_t rcode;
+
+    if (msg_len < DNS_HEADER_SIZE) {
+        return;
+    }
+    flags = dns_resolver_read16(resolver_msg + 2);
+    if (!(flags & DNS_FLAGS_QR)) {
+        return;
+    }
+
+    for (int i = 0; i < DNS_RESOLVER_ATTEMPTS_MAX; i++) {
+        if (resolver_attempts[i].active && resolver_attempts[i].id == dns_resolver_read16(resolver_msg) &&
+                resolver_servers[resolver_attempts[i].server].address == source) {
+            attempt = &resolver_attempts[i];
+            break;
+        }
+    }
+    if (attempt == NULL) {
+        tr_debug("Unexpected DNS response from %s", source.get_ip_address());
+        return;
+    }
+
+    server = &resolver_servers[attempt->server];
+    query = attempt->query;
+    latency = (uint32_t)(dns_resolver_time_ms() - attempt->sent_time);
+    rcode = flags & DNS_FLAGS_RCODE;
+
+    if (rcode != DNS_RCODE_NOERROR && rcode != DNS_RCODE_NXDOMAIN) {
+        attempt->active = false;
+        dns_resolver_server_failure(server, latency);
+        if (query != NULL) {
+            dns_resolver_attempt_failed(query, NSAPI_ERROR_DNS_FAILURE);
+        }
+        dns_resolver_timer_schedule();
+        return;
+    }
+
+    // Response of the loser is only used for the latency
+    if (query != NULL && !network_dns_msg_question_match(resolver_msg, msg_len, query->name, DNS_TYPE_AAAA)) {
+        return;
+    }
+    attempt->active = false;
+    server->latency = (server->latency == 0) ? latency : (server->latency * 3 + latency) / 4;
+    server->failures = 0;
+    server->answers++;
+    tr_debug("DNS server %s answered in %" PRIu32 " ms, average %" PRIu32 " ms", source.get_ip_address(), latency, server->latency);
+
+    if (query != NULL) {
+        // NXDOMAIN and NODATA are final answers, no point waiting for the other server
+        if (rcode == DNS_RCODE_NOERROR && network_dns_msg_aaaa_parse(resolver_msg, msg_len, address_bytes, &ttl)) {
+            address.set_ip_bytes(address_bytes, NSAPI_IPv6);
+            dns_resolver_query_complete(query, NSAPI_ERROR_OK, &address, ttl);
+        } else {
+            dns_resolver_query_complete(query, NSAPI_ERROR_DNS_FAILURE, NULL, 0);
+        }
+    }
+    dns_resolver_timer_schedule();
+}
+
+static void dns_resolver_rx(void)
+{
+    SocketAddress source;
+    nsapi_size_or_error_t ret;
+
+    resolver_rx_scheduled = false;
+
+    while ((ret = resolver_socket.recvfrom(&source, resolver_msg, sizeof(resolver_msg))) >= 0) {
+        dns_resolver_response_handle(source, (uint16_t)ret);
+    }
+}
+
+// Socket events come from the stack thread, handling is done in the event queue
+static void dns_resolver_sigio(void)
+{
+    if (!core_util_atomic_exchange_bool(&resolver_rx_scheduled, true)) {
+        app_event_call(resolver_queue, &dns_resolver_rx_site);
+    }
+}
+
+int network_dns_resolver_init(void *backbone_iface)
+{
+    nsapi_error_t ret;
+
+    if (resolver_queue != NULL) {
+        return 0;
+    }
+
+    backbone_interface = (NetworkInterface *)backbone_iface;
+
+    // Buffer size is NSAPI_INTERFACE_NAME_MAX_SIZE as required by get_interface_name()
+    if (backbone_interface->get_interface_name(network_interface_name) == NULL) {
+        tr_err("Could not get Network Interface Name");
+    }
+    network_interface_name[sizeof(network_interface_name) - 1] = '\0';
+
+    ret = resolver_socket.open(backbone_interface);
+    if (ret != NSAPI_ERROR_OK) {
+        tr_err("Could not open DNS resolver socket: %d", ret);
+        return -1;
+    }
+    resolver_socket.set_blocking(false);
+    resolver_socket.sigio(mbed::callback(dns_resolver_sigio));
+    resolver_queue = mbed_event_queue();
+    return 0;
+}
+
+int network_dns_resolver_query(const char *name, network_dns_resolver_cb_t cb, void *context)
+{
+    dns_resolver_query_t *query = NULL;
+    dns_resolver_query_t *free_query = NULL;
+
+    if (resolver_queue == NULL) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (strlen(name) >= DNS_RESOLVER_NAME_MAX_LEN) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    for (int i = 0; i < DNS_RESOLVER_QUERIES_MAX; i++) {
+        if (!resolver_queries[i].active) {
+            if (free_query == NULL) {
+                free_query = &resolver_queries[i];
+            }
+        } else if (strcasecmp(resolver_queries[i].name, name) == 0) {
+            query = &resolver_queries[i];
+            break;
+        }
+    }
+
+    if (query == NULL) {
+        if (free_query == NULL) {
+            return NSAPI_ERROR_NO_MEMORY;
+        }
+        query = free_query;
+        strcpy(query->name, name);
+        query->waiters_count = 0;
+        query->attempts = 0;
+
+        dns_resolver_servers_update();
+        dns_resolver_servers_order(query);
+        if (query->servers_count == 0) {
+            tr_warn("No DNS server on backhaul");
+            return NSAPI_ERROR_DNS_FAILURE;
+        }
+
+        // Race the fastest servers, the first answer wins
+        for (int i = 0; i < DNS_RESOLVER_RACE_WIDTH; i++) {
+            if (!dns_resolver_attempt_send(query)) {
+                break;
+            }
+        }
+        if (query->attempts == 0) {
+            return NSAPI_ERROR_DNS_FAILURE;
+        }
+        query->active = true;
+        dns_resolver_timer_schedule();
+    } else if (query->waiters_count >= DNS_RESOLVER_WAITERS_MAX) {
+        return NSAPI_ERROR_NO_MEMORY;
+    } else {
+        tr_debug("Joined outstanding query for %s", name);
+    }
+
+    // Query ids are positive
+    resolver_query_id = (resolver_query_id == INT32_MAX) ? 1 : resolver_query_id + 1;
+    query->waiters[query->waiters_count].cb = cb;
+    query->waiters[query->waiters_count].context = context;
+    query->waiters[query->waiters_count].id = resolver_query_id;
+    query->waiters_count++;
+    return resolver_query_id;
+}
+
+void network_dns_resolver_cancel(int query_id)
+{
+    for (int i = 0; i < DNS_RESOLVER_QUERIES_MAX; i++) {
+        dns_resolver_query_t *query = &resolver_queries[i];
+        if (!query->active) {
+            continue;
+        }
+        for (uint8_t j = 0; j < query->waiters_count; j++) {
+            if (query->waiters[j].id != query_id) {
+                continue;
+            }
+            query->waiters[j] = query->waiters[--query->waiters_count];
+            if (query->waiters_count == 0) {
+                // Outstanding attempts are kept for latency measurement
+                for (int k = 0; k < DNS_RESOLVER_ATTEMPTS_MAX; k++) {
+                    if (resolver_attempts[k].query == query) {
+                        resolver_attempts[k].query = NULL;
+                    }
+                }
+                query->active = false;
+            }
+            return;
+        }
+    }
+}
+#endif  //defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
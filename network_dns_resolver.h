@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_DNS_RESOLVER_H
+#define NETWORK_DNS_RESOLVER_H
+
+/* Called from the event queue, address is NULL and ttl 0 when resolution failed */
+typedef void (*network_dns_resolver_cb_t)(void *context, nsapi_error_t result, SocketAddress *address, uint32_t ttl);
+
+/* Opens the resolver socket on the backhaul interface, must be called from the event queue */
+int network_dns_resolver_init(void *backbone_iface);
+/*
+ * Resolves IPv6 address of the name. Query for a name already being resolved is joined to the
+ * outstanding query. Returns query id for network_dns_resolver_cancel() or negative error code.
+ */
+int network_dns_resolver_query(const char *name, network_dns_resolver_cb_t cb, void *context);
+/* Callback of the query is not called after cancel */
+void network_dns_resolver_cancel(int query_id);
+
+#endif /* NETWORK_DNS_RESOLVER_H */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#if defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
+
+#include "mbed.h"
+#include "mbed-cloud-client/MbedCloudClient.h"
+#include "factory_configurator_client.h"
+#include "mbed-trace/mbed_trace.h"
+#include "network_dns_uri.h"
+
+#define TRACE_GROUP "aDoU"  //Application DNS Optimization URI
+
+// Server URIs are read here instead of a heap buffer
+static uint8_t dns_uri_buffer[NETWORK_DNS_URI_MAX_LEN];
+
+int network_dns_uri_host_parse(const uint8_t *uri, size_t uri_size, char *host, size_t host_max_size)
+{
+    enum {
+        URI_SCHEME,
+        URI_SCHEME_SLASH,
+        URI_HOST_START,
+        URI_HOST,
+        URI_HOST_IPV6,
+        URI_HOST_IPV6_END,
+        URI_DONE
+    } state = URI_SCHEME;
+    size_t slashes = 0;
+    size_t host_size = 0;
+
+    for (size_t index = 0; index < uri_size && state != URI_DONE; index++) {
+        char c = (char)uri[index];
+
+        if (c == '\0') {
+            break;
+        }
+
+        switch (state) {
+            case URI_SCHEME:
+                if (c == ':') {
+                    state = URI_SCHEME_SLASH;
+                } else if (c == '/' || c == '[') {
+                    tr_err("Server URI has no scheme");
+                    return -1;
+                }
+                break;
+            case URI_SCHEME_SLASH:
+                if (c != '/') {
+                    tr_err("Server URI has no authority");
+                    return -1;
+                }
+                if (++slashes == 2) {
+                    state = URI_HOST_START;
+                }
+                break;
+            case URI_HOST_START:
+                if (c == '[') {
+                    state = URI_HOST_IPV6;
+                    break;
+                }
+                state = URI_HOST;
+            /* fall through */
+            case URI_HOST:
+                if (c == ':' || c == '/' || c == '?' || c == '#') {
+                    state = URI_DONE;
+                    break;
+                }
+                if (host_size + 1 >= host_max_size) {
+                    tr_err("Server name is too long");
+                    return -1;
+                }
+                host[host_size++] = c;
+                break;
+            case URI_HOST_IPV6:
+                if (c == ']') {
+                    state = URI_HOST_IPV6_END;
+                    break;
+                }
+                if (host_size + 1 >= host_max_size) {
+                    tr_err("Server address is too long");
+                    return -1;
+                }
+                host[host_size++] = c;
+                break;
+            case URI_HOST_IPV6_END:
+                if (c != ':' && c != '/' && c != '?' && c != '#') {
+                    tr_err("Server address is not valid");
+                    return -1;
+                }
+                state = URI_DONE;
+                break;
+            case URI_DONE:
+                break;
+        }
+    }
+
+    if ((state != URI_HOST && state != URI_HOST_IPV6_END && state != URI_DONE) || host_size == 0) {
+        tr_err("Server name is not valid");
+        return -1;
+    }
+
+    /* host is a string, need to terminate with null character */
+    host[host_size] = '\0';
+    return 0;
+}
+
+int network_dns_uri_host_get(const char *item_name, char *host, size_t host_max_size)
+{
+    size_t real_size = 0;
+
+    if (ccs_get_item(item_name, dns_uri_buffer, sizeof(dns_uri_buffer), &real_size, CCS_CONFIG_ITEM) != CCS_STATUS_SUCCESS) {
+        tr_err("ccs_get_item Failed to get %s", item_name);
+        return -1;
+    }
+    return network_dns_uri_host_parse(dns_uri_buffer, real_size, host, host_max_size);
+}
+
+#endif  //defined(MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION) && (MBED_CONF_APP_WISUN_NETWORK_DNS_OPTIMIZATION == 1)
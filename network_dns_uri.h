@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_DNS_URI_H
+#define NETWORK_DNS_URI_H
+
+#define NETWORK_DNS_URI_MAX_LEN     256
+
+/*
+ * Extracts the host of "scheme://host[:port][/path][?query]" URI in a single pass without heap allocations.
+ * IPv6 literal host "[address]" is returned without the brackets. URI ends at uri_size or at null character.
+ * Returns 0 on success, -1 if the URI is not valid or the host does not fit into host_max_size with the null.
+ */
+int network_dns_uri_host_parse(const uint8_t *uri, size_t uri_size, char *host, size_t host_max_size);
+
+/* Reads URI from the KCM config item and extracts its host, returns 0 on success */
+int network_dns_uri_host_get(const char *item_name, char *host, size_t host_max_size);
+
+#endif /* NETWORK_DNS_URI_H */
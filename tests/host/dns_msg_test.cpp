@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host unit tests of the DNS message parsers of the DNS proxy and resolver. Messages are built
+ * here and cut or corrupted to check that the parsers never read outside of the message.
+ */
+
+#include "mbed.h"
+#include "network_dns_msg.h"
+
+#define TYPE_SOA        6
+#define TYPE_CNAME      5
+#define TYPE_AAAA       28
+#define TYPE_OPT        41
+#define CLASS_IN        1
+#define POINTER_QNAME   0xC00C      // Compression pointer to the question name
+
+typedef struct test_msg {
+    uint8_t data[512];
+    uint16_t len;
+} test_msg_t;
+
+static int failures = 0;
+static int checks = 0;
+
+static void check(bool condition, const char *description)
+{
+    checks++;
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static void put8(test_msg_t *msg, uint8_t value)
+{
+    msg->data[msg->len++] = value;
+}
+
+static void put16(test_msg_t *msg, uint16_t value)
+{
+    put8(msg, (uint8_t)(value >> 8));
+    put8(msg, (uint8_t)value);
+}
+
+static void put32(test_msg_t *msg, uint32_t value)
+{
+    put16(msg, (uint16_t)(value >> 16));
+    put16(msg, (uint16_t)value);
+}
+
+static uint32_t get32(const test_msg_t *msg, uint16_t offset)
+{
+    return ((uint32_t)msg->data[offset] << 24) | ((uint32_t)msg->data[offset + 1] << 16) |
+           ((uint32_t)msg->data[offset + 2] << 8) | msg->data[offset + 3];
+}
+
+/* Dotted name in wire format */
+static void put_name(test_msg_t *msg, const char *name)
+{
+    while (*name != '\0') {
+        const char *end = strchr(name, '.');
+        size_t label_len = end ? (size_t)(end - name) : strlen(name);
+        put8(msg, (uint8_t)label_len);
+        memcpy(msg->data + msg->len, name, label_len);
+        msg->len += label_len;
+        name += label_len;
+        if (*name == '.') {
+            name++;
+        }
+    }
+    put8(msg, 0);
+}
+
+static void put_header(test_msg_t *msg, uint16_t qd_count, uint16_t an_count, uint16_t ns_count, uint16_t ar_count)
+{
+    msg->len = 0;
+    put16(msg, 0x1234);
+    put16(msg, 0x8180);
+    put16(msg, qd_count);
+    put16(msg, an_count);
+    put16(msg, ns_count);
+    put16(msg, ar_count);
+}
+
+static void put_question(test_msg_t *msg, const char *name, uint16_t qtype)
+{
+    put_name(msg, name);
+    put16(msg, qtype);
+    put16(msg, CLASS_IN);
+}
+
+/* Record owned by the question name through a compression pointer, returns offset of the TTL */
+static uint16_t put_rr(test_msg_t *msg, uint16_t type, uint32_t ttl, const uint8_t *rdata, uint16_t rdlength)
+{
+    put16(msg, POINTER_QNAME);
+    put16(msg, type);
+    put16(msg, type == TYPE_OPT ? 512 : CLASS_IN);
+    uint16_t ttl_offset = msg->len;
+    put32(msg, ttl);
+    put16(msg, rdlength);
+    memcpy(msg->data + msg->len, rdata, rdlength);
+    msg->len += rdlength;
+    return ttl_offset;
+}
+
+static void put_soa(test_msg_t *msg, uint32_t ttl, uint32_t minimum)
+{
+    test_msg_t rdata = {{0}, 0};
+
+    put_name(&rdata, "ns.example.com");
+    put_name(&rdata, "hostmaster.example.com");
+    put32(&rdata, 2021010101);
+    put32(&rdata, 7200);
+    put32(&rdata, 900);
+    put32(&rdata, 1209600);
+    put32(&rdata, minimum);
+    put_rr(msg, TYPE_SOA, ttl, rdata.data, rdata.len);
+}
+
+static const uint8_t address1[NETWORK_DNS_MSG_IPV6_SIZE] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01};
+static const uint8_t address2[NETWORK_DNS_MSG_IPV6_SIZE] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02};
+
+static void test_name_skip(void)
+{
+    test_msg_t msg;
+
+    put_header(&msg, 0, 0, 0, 0);
+    put_name(&msg, "lwm2m.example.com");
+    check(network_dns_msg_name_skip(msg.data, msg.len, NETWORK_DNS_MSG_HEADER_SIZE) == msg.len, "name skip ends after the root label");
+    check(network_dns_msg_name_skip(msg.data, msg.len - 1, NETWORK_DNS_MSG_HEADER_SIZE) < 0, "name skip of a name without the root label");
+    check(network_dns_msg_name_skip(msg.data, msg.len, msg.len) < 0, "name skip at the end of the message");
+
+    // Compression pointer ends the name and is not followed
+    put_header(&msg, 0, 0, 0, 0);
+    put8(&msg, 3);
+    put8(&msg, 'w');
+    put8(&msg, 'w');
+    put8(&msg, 'w');
+    put16(&msg, POINTER_QNAME);
+    check(network_dns_msg_name_skip(msg.data, msg.len, NETWORK_DNS_MSG_HEADER_SIZE) == msg.len, "name skip ends after a compression pointer");
+    check(network_dns_msg_name_skip(msg.data, msg.len - 1, NETWORK_DNS_MSG_HEADER_SIZE) < 0, "name skip of a truncated compression pointer");
+
+    // Label types 0x40 and 0x80 are not defined
+    put_header(&msg, 0, 0, 0, 0);
+    put8(&msg, 0x41);
+    put8(&msg, 0);
+    check(network_dns_msg_name_skip(msg.data, msg.len, NETWORK_DNS_MSG_HEADER_SIZE) < 0, "name skip of an extended label type");
+
+    // Label length past the end of the message
+    put_header(&msg, 0, 0, 0, 0);
+    put8(&msg, 63);
+    put8(&msg, 'a');
+    check(network_dns_msg_name_skip(msg.data, msg.len, NETWORK_DNS_MSG_HEADER_SIZE) < 0, "name skip of a label overrunning the message");
+}
+
+static void test_question_parse(void)
+{
+    network_dns_msg_question_t question;
+    test_msg_t msg;
+
+    put_header(&msg, 1, 0, 0, 0);
+    put_question(&msg, "LwM2M.Example.COM", TYPE_AAAA);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) == msg.len, "question parse of a query");
+    check(question.qtype == TYPE_AAAA && question.qclass == CLASS_IN, "question type and class");
+    check(question.qname_len == 19 && memcmp(question.qname, "\x05lwm2m\x07" "example\x03" "com", 19) == 0, "question name is lower case wire format");
+
+    // Every cut of the message is rejected
+    bool truncated_rejected = true;
+    for (uint16_t len = 0; len < msg.len; len++) {
+        if (network_dns_msg_question_parse(msg.data, len, &question) >= 0) {
+            truncated_rejected = false;
+        }
+    }
+    check(truncated_rejected, "question parse of truncated headers and questions");
+
+    put_header(&msg, 2, 0, 0, 0);
+    put_question(&msg, "example.com", TYPE_AAAA);
+    put_question(&msg, "example.org", TYPE_AAAA);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) < 0, "question parse of two questions");
+
+    put_header(&msg, 0, 0, 0, 0);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) < 0, "question parse without a question");
+
+    // Question names of queries are never compressed
+    put_header(&msg, 1, 0, 0, 0);
+    put16(&msg, POINTER_QNAME);
+    put16(&msg, TYPE_AAAA);
+    put16(&msg, CLASS_IN);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) < 0, "question parse of a compressed name");
+
+    // Name longer than 255 bytes in wire format
+    put_header(&msg, 1, 0, 0, 0);
+    for (int i = 0; i < 5; i++) {
+        put8(&msg, 63);
+        memset(msg.data + msg.len, 'a', 63);
+        msg.len += 63;
+    }
+    put8(&msg, 0);
+    put16(&msg, TYPE_AAAA);
+    put16(&msg, CLASS_IN);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) < 0, "question parse of a name longer than 255 bytes");
+
+    // Root name
+    put_header(&msg, 1, 0, 0, 0);
+    put_question(&msg, "", TYPE_SOA);
+    check(network_dns_msg_question_parse(msg.data, msg.len, &question) == msg.len && question.qname_len == 1, "question parse of the root name");
+}
+
+static void test_rr_walk(void)
+{
+    network_dns_msg_rr_info_t info;
+    test_msg_t msg;
+
+    // Answers through a compression pointer, smallest answer TTL, additional records are not answers
+    put_header(&msg, 1, 2, 0, 1);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    put_rr(&msg, TYPE_AAAA, 120, address2, sizeof(address2));
+    put_rr(&msg, TYPE_AAAA, 10, address2, sizeof(address2));
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) == 0, "record walk of an answer");
+    check(info.answer_min_ttl == 120, "smallest answer TTL");
+    check(!info.soa_found, "no SOA in an answer");
+
+    // Every cut of the message is rejected
+    bool truncated_rejected = true;
+    for (uint16_t len = 0; len < msg.len; len++) {
+        test_msg_t cut = msg;
+        if (network_dns_msg_rr_walk(cut.data, len, 0, &info) == 0) {
+            truncated_rejected = false;
+        }
+    }
+    check(truncated_rejected, "record walk of truncated headers and records");
+
+    // RDLENGTH past the end of the message
+    put_header(&msg, 1, 1, 0, 0);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    msg.data[msg.len - sizeof(address1) - 1] = sizeof(address1) + 1;
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) < 0, "record walk of an RDLENGTH overrun");
+    msg.data[msg.len - sizeof(address1) - 2] = 0xFF;
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) < 0, "record walk of a large RDLENGTH overrun");
+
+    // Record counts larger than the records in the message
+    put_header(&msg, 1, 0xFFFF, 0xFFFF, 0xFFFF);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) < 0, "record walk of too large record counts");
+}
+
+static void test_negative_ttl(void)
+{
+    network_dns_msg_rr_info_t info;
+    test_msg_t msg;
+
+    // SOA MINIMUM smaller than the SOA TTL
+    put_header(&msg, 1, 0, 1, 0);
+    put_question(&msg, "missing.example.com", TYPE_AAAA);
+    put_soa(&msg, 3600, 60);
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) == 0 && info.soa_found, "record walk finds the SOA");
+    check(info.negative_ttl == 60, "negative TTL is the SOA MINIMUM");
+    check(info.answer_min_ttl == UINT32_MAX, "no answer TTL without answers");
+
+    // SOA TTL smaller than the SOA MINIMUM
+    put_header(&msg, 1, 0, 1, 0);
+    put_question(&msg, "missing.example.com", TYPE_AAAA);
+    put_soa(&msg, 30, 900);
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) == 0 && info.negative_ttl == 30, "negative TTL is the SOA TTL");
+
+    // Aged SOA TTL
+    put_header(&msg, 1, 0, 1, 0);
+    put_question(&msg, "missing.example.com", TYPE_AAAA);
+    put_soa(&msg, 100, 900);
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 40, &info) == 0 && info.negative_ttl == 60, "negative TTL of an aged SOA");
+
+    // SOA in the answer section is not a negative answer
+    put_header(&msg, 1, 1, 0, 0);
+    put_question(&msg, "example.com", TYPE_SOA);
+    put_soa(&msg, 3600, 60);
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) == 0 && !info.soa_found && info.answer_min_ttl == 3600, "SOA answer");
+
+    // SOA too short for the fixed fields
+    uint8_t short_soa[19] = {0};
+    put_header(&msg, 1, 0, 1, 0);
+    put_question(&msg, "missing.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_SOA, 3600, short_soa, sizeof(short_soa));
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 0, &info) == 0 && !info.soa_found, "SOA shorter than its fixed fields is ignored");
+}
+
+static void test_ttl_aging(void)
+{
+    network_dns_msg_rr_info_t info;
+    test_msg_t msg;
+    uint8_t opt_rdata[1] = {0};
+
+    put_header(&msg, 1, 2, 0, 1);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    uint16_t ttl1 = put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    uint16_t ttl2 = put_rr(&msg, TYPE_AAAA, 50, address2, sizeof(address2));
+    uint16_t opt_ttl = put_rr(&msg, TYPE_OPT, 0x00008000, opt_rdata, 0);
+    (void)opt_rdata;
+
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 60, &info) == 0, "record walk with age");
+    check(get32(&msg, ttl1) == 240, "TTL decreased by the age in place");
+    check(get32(&msg, ttl2) == 0, "TTL smaller than the age is zero");
+    check(info.answer_min_ttl == 0, "expired answer is the smallest TTL");
+    check(get32(&msg, opt_ttl) == 0x00008000, "OPT flags are not aged");
+
+    // Walking again ages from the stored values
+    check(network_dns_msg_rr_walk(msg.data, msg.len, 40, &info) == 0 && get32(&msg, ttl1) == 200, "TTL aged again");
+}
+
+static void test_question_match(void)
+{
+    test_msg_t msg;
+
+    put_header(&msg, 1, 0, 0, 0);
+    put_question(&msg, "LwM2M.Example.com", TYPE_AAAA);
+    check(network_dns_msg_question_match(msg.data, msg.len, "lwm2m.example.com", TYPE_AAAA), "question match");
+    check(!network_dns_msg_question_match(msg.data, msg.len, "lwm2m.example.com", TYPE_SOA), "question type mismatch");
+    check(!network_dns_msg_question_match(msg.data, msg.len, "lwm2m.example.co", TYPE_AAAA), "shorter name");
+    check(!network_dns_msg_question_match(msg.data, msg.len, "lwm2m.example.com.au", TYPE_AAAA), "longer name");
+    check(!network_dns_msg_question_match(msg.data, msg.len, "lwm2m.example", TYPE_AAAA), "name with less labels");
+    check(!network_dns_msg_question_match(msg.data, msg.len, "lwm2m.examplexcom", TYPE_AAAA), "label boundary");
+
+    bool truncated_rejected = true;
+    for (uint16_t len = 0; len < msg.len; len++) {
+        if (network_dns_msg_question_match(msg.data, len, "lwm2m.example.com", TYPE_AAAA)) {
+            truncated_rejected = false;
+        }
+    }
+    check(truncated_rejected, "question match of truncated headers and questions");
+
+    // Single label with a dot is not two labels
+    put_header(&msg, 1, 0, 0, 0);
+    put8(&msg, 7);
+    memcpy(msg.data + msg.len, "example", 7);
+    msg.data[msg.len + 3] = '.';
+    msg.len += 7;
+    put8(&msg, 0);
+    put16(&msg, TYPE_AAAA);
+    put16(&msg, CLASS_IN);
+    check(!network_dns_msg_question_match(msg.data, msg.len, "exa.ple", TYPE_AAAA), "label with a dot");
+
+    // Label with a null character does not end the comparison
+    put_header(&msg, 1, 0, 0, 0);
+    put8(&msg, 3);
+    put8(&msg, 'a');
+    put8(&msg, 0);
+    put8(&msg, 'b');
+    put8(&msg, 0);
+    put16(&msg, TYPE_AAAA);
+    put16(&msg, CLASS_IN);
+    check(!network_dns_msg_question_match(msg.data, msg.len, "a", TYPE_AAAA), "label with a null character");
+
+    // Compressed question name
+    put_header(&msg, 1, 0, 0, 0);
+    put16(&msg, POINTER_QNAME);
+    put16(&msg, TYPE_AAAA);
+    put16(&msg, CLASS_IN);
+    check(!network_dns_msg_question_match(msg.data, msg.len, "example.com", TYPE_AAAA), "compressed question name");
+
+    put_header(&msg, 0, 0, 0, 0);
+    put_question(&msg, "example.com", TYPE_AAAA);
+    check(!network_dns_msg_question_match(msg.data, msg.len, "example.com", TYPE_AAAA), "question count zero");
+}
+
+static void test_aaaa_parse(void)
+{
+    uint8_t address[NETWORK_DNS_MSG_IPV6_SIZE];
+    uint8_t cname[32];
+    uint32_t ttl = 0;
+    test_msg_t msg;
+    test_msg_t cname_rdata = {{0}, 0};
+
+    // CNAME chain before the address, TTL is the smallest of the chain
+    put_name(&cname_rdata, "cdn.example.net");
+    memcpy(cname, cname_rdata.data, cname_rdata.len);
+    put_header(&msg, 1, 3, 0, 0);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_CNAME, 60, cname, cname_rdata.len);
+    put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    put_rr(&msg, TYPE_AAAA, 600, address2, sizeof(address2));
+    check(network_dns_msg_aaaa_parse(msg.data, msg.len, address, &ttl), "AAAA answer after a CNAME");
+    check(memcmp(address, address1, sizeof(address)) == 0, "first AAAA address");
+    check(ttl == 60, "TTL of the CNAME chain");
+
+    bool truncated_rejected = true;
+    for (uint16_t len = 0; len < msg.len; len++) {
+        if (network_dns_msg_aaaa_parse(msg.data, len, address, &ttl)) {
+            truncated_rejected = false;
+        }
+    }
+    check(truncated_rejected, "AAAA parse of truncated headers and records");
+
+    // AAAA with a wrong length is not an address
+    put_header(&msg, 1, 1, 0, 0);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_AAAA, 300, address1, 4);
+    check(!network_dns_msg_aaaa_parse(msg.data, msg.len, address, &ttl), "AAAA with RDLENGTH 4");
+
+    // RDLENGTH past the end of the message
+    put_header(&msg, 1, 1, 0, 0);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_rr(&msg, TYPE_AAAA, 300, address1, sizeof(address1));
+    msg.len--;
+    check(!network_dns_msg_aaaa_parse(msg.data, msg.len, address, &ttl), "AAAA RDLENGTH overrun");
+
+    // No answers
+    put_header(&msg, 1, 0, 1, 0);
+    put_question(&msg, "lwm2m.example.com", TYPE_AAAA);
+    put_soa(&msg, 3600, 60);
+    check(!network_dns_msg_aaaa_parse(msg.data, msg.len, address, &ttl), "AAAA parse of a negative answer");
+}
+
+int main(void)
+{
+    test_name_skip();
+    test_question_parse();
+    test_rr_walk();
+    test_negative_ttl();
+    test_ttl_aging();
+    test_question_match();
+    test_aaaa_parse();
+    printf("%d/%d checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
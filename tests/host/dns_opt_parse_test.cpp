@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host unit tests and micro-benchmark of the DNS optimization server URI parser.
+ * ccs_get_item() is stubbed with a table of KCM config items set by the tests.
+ */
+
+#include <chrono>
+#include "mbed.h"
+#include "mbed-cloud-client/MbedCloudClient.h"
+#include "factory_configurator_client.h"
+#include "network_dns_uri.h"
+
+#define TRACE_GROUP "test"
+#include "mbed-trace/mbed_trace.h"
+
+#define BENCH_ITERATIONS    1000000
+
+int host_trace_enabled = 0;
+
+const char g_fcc_bootstrap_server_uri_name[] = "mbed.BootstrapServerURI";
+const char g_fcc_lwm2m_server_uri_name[] = "mbed.LwM2MServerURI";
+
+static const char *stub_bootstrap_uri = NULL;
+static const char *stub_lwm2m_uri = NULL;
+static int failures = 0;
+static int checks = 0;
+
+ccs_status_e ccs_get_item(const char *key, uint8_t *buffer, size_t buffer_size, size_t *value_length, ccs_item_type_e item_type)
+{
+    const char *value = NULL;
+
+    if (item_type != CCS_CONFIG_ITEM) {
+        return CCS_STATUS_ERROR;
+    }
+    if (strcmp(key, g_fcc_bootstrap_server_uri_name) == 0) {
+        value = stub_bootstrap_uri;
+    } else if (strcmp(key, g_fcc_lwm2m_server_uri_name) == 0) {
+        value = stub_lwm2m_uri;
+    }
+    if (value == NULL) {
+        return CCS_STATUS_KEY_DOESNT_EXIST;
+    }
+    // Config items are stored without the null character, like KCM does
+    size_t length = strlen(value);
+    if (length > buffer_size) {
+        return CCS_STATUS_MEMORY_ERROR;
+    }
+    memcpy(buffer, value, length);
+    *value_length = length;
+    return CCS_STATUS_SUCCESS;
+}
+
+static void check_parse_size(const char *uri, size_t uri_size, size_t host_max_size, const char *expected)
+{
+    char host[NETWORK_DNS_URI_MAX_LEN];
+    int ret;
+
+    memset(host, 0x5a, sizeof(host));
+    ret = network_dns_uri_host_parse((const uint8_t *)uri, uri_size, host, host_max_size);
+    checks++;
+    if (expected == NULL) {
+        if (ret == 0) {
+            printf("FAIL: \"%s\" parsed to \"%s\", expected an error\n", uri, host);
+            failures++;
+        }
+        return;
+    }
+    if (ret != 0 || strcmp(host, expected) != 0) {
+        printf("FAIL: \"%s\" returned %d \"%.*s\", expected \"%s\"\n", uri, ret, ret == 0 ? (int)strlen(host) : 0, host, expected);
+        failures++;
+        return;
+    }
+    // Nothing is written past the null character
+    if ((unsigned char)host[strlen(expected) + 1] != 0x5a) {
+        printf("FAIL: \"%s\" wrote past the host\n", uri);
+        failures++;
+    }
+}
+
+static void check_parse(const char *uri, const char *expected)
+{
+    check_parse_size(uri, strlen(uri), NETWORK_DNS_URI_MAX_LEN, expected);
+}
+
+static void check_get(const char *item_name, size_t host_max_size, const char *expected)
+{
+    char host[NETWORK_DNS_URI_MAX_LEN];
+    int ret = network_dns_uri_host_get(item_name, host, host_max_size);
+
+    checks++;
+    if ((expected == NULL && ret == 0) || (expected != NULL && (ret != 0 || strcmp(host, expected) != 0))) {
+        printf("FAIL: %s returned %d, expected %s\n", item_name, ret, expected ? expected : "an error");
+        failures++;
+    }
+}
+
+static void test_host_names(void)
+{
+    check_parse("coaps://bootstrap.us-east-1.mbedcloud.com:5684", "bootstrap.us-east-1.mbedcloud.com");
+    check_parse("coap://lwm2m.us-east-1.mbedcloud.com", "lwm2m.us-east-1.mbedcloud.com");
+    check_parse("coaps://lwm2m.us-east-1.mbedcloud.com:5684?aid=016b5d6d8f3d0000000000010010038b", "lwm2m.us-east-1.mbedcloud.com");
+    check_parse("coaps://lwm2m.mbedcloud.com/path/to?x=1", "lwm2m.mbedcloud.com");
+    check_parse("coaps://lwm2m.mbedcloud.com?aid=1", "lwm2m.mbedcloud.com");
+    check_parse("coaps://lwm2m.mbedcloud.com#fragment", "lwm2m.mbedcloud.com");
+    check_parse("coaps://192.0.2.1:5684", "192.0.2.1");
+}
+
+static void test_ipv6_literals(void)
+{
+    check_parse("coaps://[2001:db8::1]:5684", "2001:db8::1");
+    check_parse("coaps://[2001:db8::1]", "2001:db8::1");
+    check_parse("coaps://[2001:db8::1]/path", "2001:db8::1");
+    check_parse("coaps://[fe80::1%25eth0]:5684?aid=1", "fe80::1%25eth0");
+    check_parse("coaps://[2001:db8::1", NULL);
+    check_parse("coaps://[2001:db8::1]x", NULL);
+    check_parse("coaps://[]:5684", NULL);
+}
+
+static void test_malformed(void)
+{
+    check_parse("", NULL);
+    check_parse("lwm2m.mbedcloud.com:5684", NULL);
+    check_parse("lwm2m.mbedcloud.com", NULL);
+    check_parse("/lwm2m.mbedcloud.com", NULL);
+    check_parse("[2001:db8::1]:5684", NULL);
+    check_parse("coaps:/lwm2m.mbedcloud.com", NULL);
+    check_parse("coaps:lwm2m.mbedcloud.com", NULL);
+    check_parse("coaps://", NULL);
+    check_parse("coaps://:5684", NULL);
+    check_parse("coaps:///path", NULL);
+}
+
+static void test_bounds(void)
+{
+    const char *uri = "coaps://lwm2m.mbedcloud.com:5684";
+
+    // Value ends at the item size without a null character
+    check_parse_size(uri, strlen("coaps://lwm2m"), NETWORK_DNS_URI_MAX_LEN, "lwm2m");
+    // Null character ends the value before the item size
+    check_parse_size("coaps://abc\0def", 15, NETWORK_DNS_URI_MAX_LEN, "abc");
+    // Host and the null character fit exactly, one less does not
+    check_parse_size(uri, strlen(uri), strlen("lwm2m.mbedcloud.com") + 1, "lwm2m.mbedcloud.com");
+    check_parse_size(uri, strlen(uri), strlen("lwm2m.mbedcloud.com"), NULL);
+    check_parse_size("coaps://[2001:db8::1]", 21, strlen("2001:db8::1"), NULL);
+    check_parse_size(uri, strlen(uri), 0, NULL);
+}
+
+static void test_kcm_items(void)
+{
+    static char long_host_uri[NETWORK_DNS_URI_MAX_LEN + 1];
+    static char long_host[NETWORK_DNS_URI_MAX_LEN];
+    static char oversize_uri[NETWORK_DNS_URI_MAX_LEN + 32];
+
+    stub_bootstrap_uri = "coaps://bootstrap.us-east-1.mbedcloud.com:5684";
+    stub_lwm2m_uri = "coaps://[2001:db8::1]:5684?aid=1";
+    check_get(g_fcc_bootstrap_server_uri_name, 128, "bootstrap.us-east-1.mbedcloud.com");
+    check_get(g_fcc_lwm2m_server_uri_name, 128, "2001:db8::1");
+
+    // Missing item
+    stub_lwm2m_uri = NULL;
+    check_get(g_fcc_lwm2m_server_uri_name, 128, NULL);
+
+    // URI filling the whole read buffer, host does not fit into a DNS name buffer
+    memcpy(long_host_uri, "coaps://", 8);
+    memset(long_host_uri + 8, 'a', NETWORK_DNS_URI_MAX_LEN - 8);
+    long_host_uri[NETWORK_DNS_URI_MAX_LEN] = '\0';
+    strcpy(long_host, long_host_uri + 8);
+    stub_bootstrap_uri = long_host_uri;
+    check_get(g_fcc_bootstrap_server_uri_name, 128, NULL);
+    check_get(g_fcc_bootstrap_server_uri_name, NETWORK_DNS_URI_MAX_LEN - 8 + 1, long_host);
+    check_get(g_fcc_bootstrap_server_uri_name, NETWORK_DNS_URI_MAX_LEN - 8, NULL);
+
+    // URI larger than the read buffer
+    memcpy(oversize_uri, "coaps://", 8);
+    memset(oversize_uri + 8, 'b', sizeof(oversize_uri) - 9);
+    oversize_uri[sizeof(oversize_uri) - 1] = '\0';
+    stub_bootstrap_uri = oversize_uri;
+    check_get(g_fcc_bootstrap_server_uri_name, 128, NULL);
+
+    stub_bootstrap_uri = NULL;
+}
+
+/* Parser before the single pass parser, two passes and a heap copy of the host, as a reference */
+static int legacy_parse_address(uint8_t *raw_addr, int raw_addr_size, char **parsed_addr)
+{
+    int size_index;
+    int end_index = -1;
+    int start_index = -1;
+    int parsed_addr_size = 0;
+
+    for (size_index = 0; size_index < raw_addr_size; size_index++) {
+        if (raw_addr[size_index] == ':') {
+            end_index = size_index;
+        }
+    }
+    if (end_index == -1) {
+        return -1;
+    }
+    for (size_index = 0; size_index < end_index; size_index++) {
+        if (raw_addr[size_index] == '/') {
+            start_index = size_index;
+        }
+    }
+    if (start_index == -1) {
+        return -1;
+    }
+    start_index++;
+    parsed_addr_size = end_index - start_index;
+    if (*parsed_addr == NULL) {
+        *parsed_addr = (char *)malloc(parsed_addr_size + 1);
+    }
+    if (*parsed_addr == NULL) {
+        return -1;
+    }
+    memcpy(*parsed_addr, raw_addr + start_index, parsed_addr_size);
+    *(*parsed_addr + parsed_addr_size) = '\0';
+    return 0;
+}
+
+static double bench_ns_per_op(std::chrono::steady_clock::time_point start, uint32_t operations)
+{
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / operations;
+}
+
+static void bench(void)
+{
+    static const char *const uris[] = {
+        "coaps://bootstrap.us-east-1.mbedcloud.com:5684",
+        "coaps://lwm2m.us-east-1.mbedcloud.com:5684?aid=016b5d6d8f3d0000000000010010038b",
+    };
+    const size_t uri_count = sizeof(uris) / sizeof(uris[0]);
+    char host[128];
+    volatile size_t sink = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        const char *uri = uris[i % uri_count];
+        if (network_dns_uri_host_parse((const uint8_t *)uri, strlen(uri), host, sizeof(host)) == 0) {
+            sink += host[0];
+        }
+    }
+    printf("network_dns_uri_host_parse    %8.1f ns/op\n", bench_ns_per_op(start, BENCH_ITERATIONS));
+
+    // The old code malloced the read buffer and the host for every call
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        const char *uri = uris[i % uri_count];
+        uint8_t *buffer = (uint8_t *)malloc(NETWORK_DNS_URI_MAX_LEN);
+        char *parsed = NULL;
+        size_t length = strlen(uri);
+        memcpy(buffer, uri, length);
+        if (legacy_parse_address(buffer, (int)length, &parsed) == 0) {
+            sink += parsed[0];
+        }
+        free(parsed);
+        free(buffer);
+    }
+    printf("legacy parse_address + malloc %8.1f ns/op\n", bench_ns_per_op(start, BENCH_ITERATIONS));
+
+    stub_bootstrap_uri = uris[0];
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        if (network_dns_uri_host_get(g_fcc_bootstrap_server_uri_name, host, sizeof(host)) == 0) {
+            sink += host[0];
+        }
+    }
+    printf("network_dns_uri_host_get      %8.1f ns/op\n", bench_ns_per_op(start, BENCH_ITERATIONS));
+    stub_bootstrap_uri = NULL;
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    bool run_bench = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            run_bench = true;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            host_trace_enabled = 1;
+        }
+    }
+
+    test_host_names();
+    test_ipv6_literals();
+    test_malformed();
+    test_bounds();
+    test_kcm_items();
+    printf("%d/%d checks passed\n", checks - failures, checks);
+
+    if (run_bench) {
+        bench();
+    }
+    return failures ? 1 : 0;
+}
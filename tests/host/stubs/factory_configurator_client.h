@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_STUB_FACTORY_CONFIGURATOR_CLIENT_H
+#define HOST_STUB_FACTORY_CONFIGURATOR_CLIENT_H
+
+extern const char g_fcc_bootstrap_server_uri_name[];
+extern const char g_fcc_lwm2m_server_uri_name[];
+
+#endif /* HOST_STUB_FACTORY_CONFIGURATOR_CLIENT_H */
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host stand-in for the cloud client storage API, items are served by the test */
+#ifndef HOST_STUB_MBED_CLOUD_CLIENT_H
+#define HOST_STUB_MBED_CLOUD_CLIENT_H
+
+typedef enum {
+    CCS_STATUS_SUCCESS = 0,
+    CCS_STATUS_ERROR,
+    CCS_STATUS_KEY_DOESNT_EXIST,
+    CCS_STATUS_MEMORY_ERROR
+} ccs_status_e;
+
+typedef enum {
+    CCS_PRIVATE_KEY_ITEM,
+    CCS_PUBLIC_KEY_ITEM,
+    CCS_SYMMETRIC_KEY_ITEM,
+    CCS_CERTIFICATE_ITEM,
+    CCS_CONFIG_ITEM
+} ccs_item_type_e;
+
+ccs_status_e ccs_get_item(const char *key, uint8_t *buffer, size_t buffer_size, size_t *value_length, ccs_item_type_e item_type);
+
+#endif /* HOST_STUB_MBED_CLOUD_CLIENT_H */
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_STUB_MBED_TRACE_H
+#define HOST_STUB_MBED_TRACE_H
+
+/* Traces are printed only when the test enables them, so benchmarks measure the code */
+extern int host_trace_enabled;
+
+#define host_trace(level, ...) do { if (host_trace_enabled) { printf("[" level "][" TRACE_GROUP "]: "); printf(__VA_ARGS__); printf("\n"); } } while (0)
+#define tr_debug(...)   host_trace("DBG ", __VA_ARGS__)
+#define tr_info(...)    host_trace("INFO", __VA_ARGS__)
+#define tr_warn(...)    host_trace("WARN", __VA_ARGS__)
+#define tr_err(...)     host_trace("ERR ", __VA_ARGS__)
+#define tr_error(...)   host_trace("ERR ", __VA_ARGS__)
+
+#endif /* HOST_STUB_MBED_TRACE_H */
@@ -0,0 +1,596 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright 2021 Pelion
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ----------------------------------------------------------------------------
+"""
+Replays a nanostack heap allocation trace recorded with
+nsdynmemtracker-alloc-trace-size on a model of the nsdynmem allocator.
+
+The trace is read from a serial log with "NSDYNMEM alloc trace: <base64>"
+lines. Reports peak live memory, peak heap usage with block overhead,
+fragmentation at the peak, failures on the given heap size and the smallest
+heap size that the trace fits in, and the allocation latency and tracker
+overhead measured on device.
+
+A trace with records dropped on device or trace lines missing from the log is
+refused, as the replay of it is not reliable. With --allow-dropped it is
+replayed and the report is marked incomplete.
+
+    nsdynmem_alloc_trace.py serial.log --heap-size 317440 --map BUILD/pelion-border-router.map
+
+With --sample-rate N the tracker sampling is replayed on the trace. The live
+memory per caller at the peak, estimated from 1 in N sampled allocations, is
+compared with the exact value for the per allocation sampling of the tracker
+and for sampling by block address. The share of allocations recorded by the
+tracker and the ext memory blocks table probes of the free path are reported
+as the overhead.
+
+The allocator model places temporary allocations first fit from the start of
+the heap and other allocations first fit from the end, with a 4 byte size
+header and trailer per block, as nsdynmemLIB does.
+
+With --pool-size-classes the size class pools of nsdynmemtracker-pool-size-classes
+are replayed in front of the heap model. On every --print-interval the classes
+are grown to the live allocation count of the --top-allocators callers that fit
+them, slabs are allocated from the end of the heap model and empty slabs are
+released, as nanostack_dynmempool.cpp does. Allocations whose class has no free
+block fall back to the heap model.
+
+All heap and pool results are estimates. The allocator and the pools are
+Python models of nsdynmemLIB and nanostack_dynmempool.cpp, not the code that
+runs on the device, and the pool demand is taken from the exact live
+allocations instead of the tracker lists. Pool region (ns_dyn_mem_pool_region_set)
+is not modelled, slabs are always taken from the heap.
+
+    nsdynmem_alloc_trace.py serial.log --heap-size 317440 --pool-size-classes 16,32,64,128
+"""
+
+import argparse
+import base64
+import bisect
+import re
+import struct
+import sys
+
+from nsdynmem_snapshot import Symbolizer
+
+MAGIC = 0x5441534E
+HEADER = struct.Struct("<IHHI")
+RECORD = struct.Struct("<IIIHBxHH")
+OP_ALLOC, OP_TEMPORARY_ALLOC, OP_FREE = 0, 1, 2
+TRACE_LINE = re.compile(r"NSDYNMEM alloc trace: ([A-Za-z0-9+/=]+)")
+BLOCK_OVERHEAD = 8
+MIN_SPLIT = BLOCK_OVERHEAD + 4
+MASK32 = 0xFFFFFFFF
+EXT_MEM_BLOCKS_COUNT = 2047
+EXT_MEM_BLOCKS_MAX_COUNT = (1024 << 6) - 1
+EXT_MEM_BLOCKS_GROW_LOAD_PERCENT = 75
+POINTER_SIZE = 4
+SAMPLE_RUNS = 5
+TIME_SATURATED = 0xFFFF
+
+
+def read_trace(path):
+    """
+    Returns list of (time, caller, block, size, op) records of a serial log, list of (op, alloc_time,
+    tracker_time) timings of the records, and the number of records dropped and trace lines missing.
+    """
+    records = []
+    timings = []
+    expected_sequence = None
+    dropped = 0
+    missing_lines = 0
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            match = TRACE_LINE.search(line)
+            if not match:
+                continue
+            data = base64.b64decode(match.group(1))
+            magic, sequence, count, dropped = HEADER.unpack_from(data)
+            if magic != MAGIC or len(data) < HEADER.size + count * RECORD.size:
+                print("warning: malformed trace line", file=sys.stderr)
+                continue
+            if expected_sequence is not None and sequence != expected_sequence:
+                missing_lines += (sequence - expected_sequence) & 0xFFFF
+            expected_sequence = (sequence + 1) & 0xFFFF
+            for index in range(count):
+                record = RECORD.unpack_from(data, HEADER.size + index * RECORD.size)
+                records.append(record[:5])
+                timings.append((record[4], record[5], record[6]))
+    if not records:
+        raise ValueError("no allocation trace in %s" % path)
+    return records, timings, dropped, missing_lines
+
+
+class Heap:
+    """First fit model of nsdynmem, temporary allocations from the start and others from the end."""
+
+    def __init__(self, size):
+        self.size = size & ~3
+        self.free_starts = [0]
+        self.free_sizes = [self.size]
+        self.used = 0
+
+    def alloc(self, size, temporary):
+        need = ((size + 3) & ~3) + BLOCK_OVERHEAD
+        indexes = range(len(self.free_starts)) if temporary else range(len(self.free_starts) - 1, -1, -1)
+        for index in indexes:
+            free_size = self.free_sizes[index]
+            if free_size < need:
+                continue
+            start = self.free_starts[index]
+            if free_size - need < MIN_SPLIT:
+                # Remainder too small for a block, whole free block is used
+                need = free_size
+                del self.free_starts[index]
+                del self.free_sizes[index]
+            elif temporary:
+                self.free_starts[index] = start + need
+                self.free_sizes[index] = free_size - need
+            else:
+                self.free_sizes[index] = free_size - need
+                start = start + free_size - need
+            self.used += need
+            return start, need
+        return None
+
+    def free(self, block):
+        start, size = block
+        self.used -= size
+        index = bisect.bisect_left(self.free_starts, start)
+        # Merge with the following and the preceding free blocks
+        if index < len(self.free_starts) and self.free_starts[index] == start + size:
+            size += self.free_sizes[index]
+            del self.free_starts[index]
+            del self.free_sizes[index]
+        if index > 0 and self.free_starts[index - 1] + self.free_sizes[index - 1] == start:
+            self.free_sizes[index - 1] += size
+        else:
+            self.free_starts.insert(index, start)
+            self.free_sizes.insert(index, size)
+
+    def fragmentation(self):
+        total = sum(self.free_sizes)
+        return 1.0 - max(self.free_sizes) / total if total else 0.0
+
+
+class PoolClass:
+    """Size class pool of nanostack_dynmempool.cpp, free list of blocks in slabs allocated from the heap."""
+
+    def __init__(self, size):
+        self.size = size
+        self.block_size = (max(size, POINTER_SIZE) + POINTER_SIZE - 1) & ~(POINTER_SIZE - 1)
+        # Slab is [heap block, blocks, used], free list holds (slab, block index), lowest address first
+        self.slabs = []
+        self.free_list = []
+        self.capacity = 0
+        self.in_use = 0
+        self.in_use_max = 0
+        self.demand = 0
+        self.alloc_count = 0
+        self.fallback_count = 0
+        self.grow_failures = 0
+
+
+class Pool:
+    """Size class pools in front of the heap model, grown and shrunk only on the demand update."""
+
+    def __init__(self, heap, sizes, slab_blocks, max_slabs):
+        self.heap = heap
+        self.classes = [PoolClass(size) for size in sizes]
+        self.slab_blocks = slab_blocks
+        self.max_slabs = max_slabs
+
+    def class_find(self, size):
+        for pool_class in self.classes:
+            if size <= pool_class.size:
+                return pool_class
+        return None
+
+    def alloc(self, size):
+        """Returns (class, slab, block index) or None when the allocation goes to the heap."""
+        pool_class = self.class_find(size)
+        if pool_class is None:
+            return None
+        if not pool_class.free_list:
+            pool_class.fallback_count += 1
+            return None
+        slab, block_index = pool_class.free_list.pop()
+        slab[2] += 1
+        pool_class.alloc_count += 1
+        pool_class.in_use += 1
+        pool_class.in_use_max = max(pool_class.in_use_max, pool_class.in_use)
+        return pool_class, slab, block_index
+
+    def free(self, block):
+        pool_class, slab, block_index = block
+        pool_class.free_list.append((slab, block_index))
+        slab[2] -= 1
+        pool_class.in_use -= 1
+
+    def _grow(self, pool_class):
+        if len(pool_class.slabs) >= self.max_slabs:
+            return False
+        blocks = self.slab_blocks
+        if pool_class.demand > pool_class.capacity + blocks:
+            blocks = min(pool_class.demand - pool_class.capacity, self.slab_blocks * 4)
+        # Slabs are long-term allocations from the end of the heap
+        heap_block = self.heap.alloc(blocks * pool_class.block_size, False)
+        if heap_block is None:
+            pool_class.grow_failures += 1
+            return False
+        slab = [heap_block, blocks, 0]
+        pool_class.slabs.append(slab)
+        pool_class.free_list.extend((slab, block_index) for block_index in range(blocks - 1, -1, -1))
+        pool_class.capacity += blocks
+        return True
+
+    def _shrink(self, pool_class):
+        for slab in pool_class.slabs:
+            if slab[2] > 0 or pool_class.capacity - slab[1] < pool_class.demand + self.slab_blocks:
+                continue
+            pool_class.free_list = [entry for entry in pool_class.free_list if entry[0] is not slab]
+            pool_class.capacity -= slab[1]
+            pool_class.slabs.remove(slab)
+            self.heap.free(slab[0])
+            return
+
+    def demand_update(self, callers, top):
+        """Demand of a class is the live count of the top callers by memory whose average allocation fits it."""
+        demand = {id(pool_class): 0 for pool_class in self.classes}
+        for count, total in sorted(callers.values(), key=lambda value: -value[1])[:top]:
+            pool_class = self.class_find(total // count) if count else None
+            if pool_class is not None:
+                demand[id(pool_class)] += count
+        for pool_class in self.classes:
+            pool_class.demand = demand[id(pool_class)]
+            if pool_class.demand > pool_class.capacity:
+                while pool_class.demand > pool_class.capacity and self._grow(pool_class):
+                    pass
+            else:
+                self._shrink(pool_class)
+
+
+def replay(records, heap_size, pool_config=None):
+    """Replays the records on the heap model, and on the size class pools in front of it with pool_config."""
+    heap = Heap(heap_size)
+    pool = None
+    next_update = None
+    callers = {}
+    if pool_config:
+        pool = Pool(heap, pool_config["sizes"], pool_config["slab_blocks"], pool_config["max_slabs"])
+        next_update = records[0][0] + pool_config["interval"]
+    live = {}
+    result = {"failures": 0, "device_failures": 0, "unmatched_frees": 0, "peak_used": 0, "peak_index": 0,
+              "peak_fragmentation": 0.0, "peak_requested": 0, "requested": 0, "pool": pool}
+    for index, (time, caller, block, size, op) in enumerate(records):
+        if pool is not None and ((time - next_update) & MASK32) < 0x80000000:
+            pool.demand_update(callers, pool_config["top"])
+            next_update = (time + pool_config["interval"]) & MASK32
+
+        if op == OP_FREE:
+            entry = live.pop(block, None)
+            if entry is None:
+                if block:
+                    result["unmatched_frees"] += 1
+                continue
+            result["requested"] -= entry[1]
+            if pool is not None:
+                count, total = callers[entry[2]]
+                callers[entry[2]] = (count - 1, total - entry[1])
+            if entry[3] is not None:
+                pool.free(entry[3])
+            elif entry[0] is not None:
+                heap.free(entry[0])
+            continue
+
+        if not block:
+            # Failed on device, nothing to free later
+            result["device_failures"] += 1
+            continue
+        heap_block = None
+        pool_block = pool.alloc(size) if pool is not None else None
+        if pool_block is None:
+            heap_block = heap.alloc(size, op == OP_TEMPORARY_ALLOC)
+            if heap_block is None:
+                result["failures"] += 1
+        live[block] = (heap_block, size, caller, pool_block)
+        if pool is not None:
+            count, total = callers.get(caller, (0, 0))
+            callers[caller] = (count + 1, total + size)
+        result["requested"] += size
+        result["peak_requested"] = max(result["peak_requested"], result["requested"])
+        if heap.used > result["peak_used"]:
+            result["peak_used"] = heap.used
+            result["peak_index"] = index
+            result["peak_fragmentation"] = heap.fragmentation()
+    return result
+
+
+def pool_report(pool):
+    print("\nsize class pools at the end of the trace (estimate):")
+    print("%-8s %8s %8s %8s %6s %8s %10s %10s %8s" % (
+        "class", "used", "capacity", "max", "slabs", "demand", "allocs", "fallbacks", "grow fail"))
+    for pool_class in pool.classes:
+        print("%-8d %8d %8d %8d %6d %8d %10d %10d %8d" % (
+            pool_class.size, pool_class.in_use, pool_class.capacity, pool_class.in_use_max, len(pool_class.slabs),
+            pool_class.demand, pool_class.alloc_count, pool_class.fallback_count, pool_class.grow_failures))
+
+
+def live_at(records, end_index):
+    """Returns live bytes and allocation counts per caller after record end_index."""
+    live = {}
+    for time, caller, block, size, op in records[:end_index + 1]:
+        if op == OP_FREE:
+            live.pop(block, None)
+        elif block:
+            live[block] = (caller, size)
+    callers = {}
+    for caller, size in live.values():
+        count, total = callers.get(caller, (0, 0))
+        callers[caller] = (count + 1, total + size)
+    return callers
+
+
+def block_index_hash(block, count):
+    """lowbias32 block index hash of the tracker."""
+    value = (block >> 2) & MASK32
+    value ^= value >> 16
+    value = (value * 0x7FEB352D) & MASK32
+    value ^= value >> 15
+    value = (value * 0x846CA68B) & MASK32
+    value ^= value >> 16
+    return (value * count) >> 32
+
+
+class ExtMemBlocks:
+    """Ext memory blocks table of the tracker, linear probing and growth at 75 % load."""
+
+    def __init__(self):
+        self.slots = [None] * EXT_MEM_BLOCKS_COUNT
+        self.used = 0
+        self.probe_max = 0
+        self.lookups = 0
+        self.lookup_probes = 0
+
+    def _insert(self, block):
+        index = block_index_hash(block, len(self.slots))
+        probe = 0
+        while self.slots[index] is not None:
+            index = (index + 1) % len(self.slots)
+            probe += 1
+        self.slots[index] = block
+        self.probe_max = max(self.probe_max, probe)
+
+    def insert(self, block):
+        self._insert(block)
+        self.used += 1
+        if (len(self.slots) < EXT_MEM_BLOCKS_MAX_COUNT and
+                self.used * 100 >= len(self.slots) * EXT_MEM_BLOCKS_GROW_LOAD_PERCENT):
+            blocks = [slot for slot in self.slots if slot is not None]
+            self.slots = [None] * min(len(self.slots) + len(self.slots) // 2, EXT_MEM_BLOCKS_MAX_COUNT)
+            self.probe_max = 0
+            for slot in blocks:
+                self._insert(slot)
+
+    def remove(self, block):
+        """Looks up the block within the longest probe sequence, removes it and returns True if found."""
+        index = block_index_hash(block, len(self.slots))
+        self.lookups += 1
+        for probe in range(self.probe_max + 1):
+            self.lookup_probes += 1
+            if self.slots[index] == block:
+                self.slots[index] = None
+                self.used -= 1
+                return True
+            index = (index + 1) % len(self.slots)
+        return False
+
+
+def sample_by_address(rate):
+    """Fibonacci hash of the block address, decides the same for the allocation and the free."""
+    threshold = MASK32 // rate
+    return lambda block: ((block >> 2) * 0x9E3779B1) & MASK32 <= threshold
+
+
+def sample_per_allocation(rate, seed):
+    """Countdown with random intervals of mean rate, as the tracker does."""
+    state = {"countdown": 1, "random": (0x9E3779B9 + seed * 0x6D2B79F5) & MASK32 or 1}
+
+    def sample(block):
+        state["countdown"] -= 1
+        if state["countdown"]:
+            return False
+        value = state["random"]
+        value ^= (value << 13) & MASK32
+        value ^= value >> 17
+        value ^= (value << 5) & MASK32
+        state["random"] = value
+        state["countdown"] = 1 + value % (2 * rate - 1)
+        return True
+    return sample
+
+
+def sample_replay(records, end_index, rate, sample, table=None):
+    """Returns estimated live bytes per caller after record end_index and the recorded allocation count."""
+    live = {}
+    recorded = 0
+    for time, caller, block, size, op in records[:end_index + 1]:
+        if op == OP_FREE:
+            if table is not None:
+                if block and table.remove(block):
+                    live.pop(block, None)
+            else:
+                live.pop(block, None)
+        elif block and sample(block):
+            recorded += 1
+            live[block] = (caller, size)
+            if table is not None:
+                table.insert(block)
+    callers = {}
+    for caller, size in live.values():
+        callers[caller] = callers.get(caller, 0) + size * rate
+    return callers, recorded
+
+
+def sampling_report(records, end_index, rate, top):
+    exact = live_at(records, end_index)
+    allocs = sum(1 for record in records[:end_index + 1] if record[4] != OP_FREE and record[2])
+    callers = sorted(exact.items(), key=lambda item: -item[1][1])[:top]
+
+    by_address, address_recorded = sample_replay(records, end_index, rate, sample_by_address(rate))
+    runs = []
+    for seed in range(SAMPLE_RUNS):
+        table = ExtMemBlocks()
+        estimate, recorded = sample_replay(records, end_index, rate, sample_per_allocation(rate, seed), table)
+        runs.append((estimate, recorded, table))
+
+    def error(estimate, total):
+        return 100.0 * (estimate - total) / total
+
+    print("\nsampling 1 in %d, live memory at peak usage, estimate error per caller:" % rate)
+    print("%-10s %10s %10s %20s" % ("caller", "memory", "address", "per allocation"))
+    address_errors, allocation_errors = [], []
+    for caller, (count, total) in callers:
+        address_error = error(by_address.get(caller, 0), total)
+        errors = [error(run[0].get(caller, 0), total) for run in runs]
+        mean = sum(errors) / len(errors)
+        spread = (sum((value - mean) ** 2 for value in errors) / len(errors)) ** 0.5
+        address_errors.append(abs(address_error))
+        allocation_errors.extend(abs(value) for value in errors)
+        print("0x%08x %10d %9.1f%% %8.1f%% sd %5.1f%%" % (caller, total, address_error, mean, spread))
+    if callers:
+        print("mean absolute error: address %.1f%% per allocation %.1f%%" % (
+            sum(address_errors) / len(address_errors), sum(allocation_errors) / len(allocation_errors)))
+    lookups = sum(run[2].lookups for run in runs)
+    probes = sum(run[2].lookup_probes for run in runs)
+    print("recorded allocations: address %.1f%% per allocation %.1f%% of %d" % (
+        100.0 * address_recorded / allocs, 100.0 * sum(run[1] for run in runs) / (allocs * SAMPLE_RUNS), allocs))
+    print("free path: address 1 hash, per allocation %.2f table probes per free, longest probe sequence %d" % (
+        probes / lookups if lookups else 0.0, max(run[2].probe_max for run in runs)))
+
+
+def percentile(values, percent):
+    return values[min(len(values) - 1, len(values) * percent // 100)]
+
+
+def timing_report(timings):
+    """Allocation latency and tracker overhead in microseconds measured on device."""
+    print("\ntime on device in microseconds:")
+    print("%-16s %8s %8s %8s %8s %8s %10s" % ("", "count", "mean", "median", "p99", "max", "saturated"))
+    rows = [("allocation", [alloc for op, alloc, tracker in timings if op == OP_ALLOC]),
+            ("temporary alloc", [alloc for op, alloc, tracker in timings if op == OP_TEMPORARY_ALLOC]),
+            ("tracker alloc", [tracker for op, alloc, tracker in timings if op != OP_FREE]),
+            ("tracker free", [tracker for op, alloc, tracker in timings if op == OP_FREE])]
+    for name, values in rows:
+        if not values:
+            continue
+        values.sort()
+        print("%-16s %8d %8.1f %8d %8d %8d %10d" % (
+            name, len(values), sum(values) / len(values), percentile(values, 50), percentile(values, 99),
+            values[-1], sum(1 for value in values if value == TIME_SATURATED)))
+    alloc_time = sum(alloc for op, alloc, tracker in timings if op != OP_FREE)
+    tracker_time = sum(tracker for op, alloc, tracker in timings if op != OP_FREE)
+    if alloc_time:
+        print("tracker overhead on allocations: %.1f%% of the allocator time, allocator time of frees is not measured" % (
+            100.0 * tracker_time / alloc_time))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", help="serial log with allocation trace lines")
+    parser.add_argument("--heap-size", type=int, default=310 * 1024, help="heap size to replay on in bytes, default 310 KB")
+    parser.add_argument("--top", type=int, default=10, help="number of callers listed at the peak")
+    parser.add_argument("--sample-rate", type=int, help="replay tracker sampling of 1 in N allocations")
+    parser.add_argument("--pool-size-classes", help="replay size class pools with these block sizes, e.g. 16,32,64,128")
+    parser.add_argument("--pool-slab-blocks", type=int, default=16, help="minimum blocks in a pool slab, default 16")
+    parser.add_argument("--pool-max-slabs", type=int, default=8, help="maximum slabs in a size class pool, default 8")
+    parser.add_argument("--print-interval", type=int, default=300, help="tracker print interval of the pool demand update in seconds, default 300")
+    parser.add_argument("--top-allocators", type=int, default=5, help="tracker top allocators list size of the pool demand, default 5")
+    parser.add_argument("--allow-dropped", action="store_true", help="replay a trace with dropped records, marked incomplete")
+    parser.add_argument("--elf", help="application ELF file for addr2line symbolization")
+    parser.add_argument("--map", help="application map file for symbolization without toolchain")
+    parser.add_argument("--addr2line", default="arm-none-eabi-addr2line", help="addr2line executable")
+    args = parser.parse_args()
+
+    try:
+        records, timings, dropped, missing_lines = read_trace(args.trace)
+    except (OSError, ValueError) as error:
+        sys.exit(str(error))
+
+    incomplete = ""
+    if dropped or missing_lines:
+        incomplete = "INCOMPLETE TRACE: %d records dropped on device, %d trace lines missing from the log" % (dropped, missing_lines)
+        if not args.allow_dropped:
+            sys.exit("error: %s, replay with --allow-dropped to report it anyway, or enlarge "
+                     "nsdynmemtracker-alloc-trace-size" % incomplete)
+        print("%s, the results below are not reliable\n" % incomplete)
+
+    pool_config = None
+    if args.pool_size_classes:
+        try:
+            sizes = sorted(int(size) for size in args.pool_size_classes.strip("{}").split(","))
+        except ValueError:
+            sys.exit("error: --pool-size-classes must be a comma separated list of block sizes")
+        pool_config = {"sizes": sizes, "slab_blocks": args.pool_slab_blocks, "max_slabs": args.pool_max_slabs,
+                       "interval": args.print_interval * 1000, "top": args.top_allocators}
+
+    result = replay(records, args.heap_size, pool_config)
+    duration = (records[-1][0] - records[0][0]) / 1000.0
+    allocs = sum(1 for record in records if record[4] != OP_FREE)
+    print("records: %d allocations: %d over %.1f s" % (len(records), allocs, duration))
+    print("device allocation failures: %d unmatched frees: %d" % (result["device_failures"], result["unmatched_frees"]))
+    print("peak live memory: %d bytes" % result["peak_requested"])
+    print("estimated heap size %d: peak usage %d bytes (%.1f%%) fragmentation at peak %.1f%% failures %d" % (
+        args.heap_size, result["peak_used"], 100.0 * result["peak_used"] / args.heap_size,
+        100.0 * result["peak_fragmentation"], result["failures"]))
+
+    # Smallest heap without failures, failures are monotonic enough for a binary search
+    low, high = result["peak_requested"], max(args.heap_size, result["peak_used"]) * 2
+    if replay(records, high, pool_config)["failures"] == 0:
+        while high - low > 256:
+            middle = (low + high) // 2
+            if replay(records, middle, pool_config)["failures"]:
+                low = middle
+            else:
+                high = middle
+        print("estimated smallest heap without failures: about %d bytes" % high)
+    else:
+        print("trace does not fit in %d bytes" % high)
+
+    peak = records[result["peak_index"]]
+    symbolize = Symbolizer(args.elf, args.map, args.addr2line)
+    print("\nlive memory at peak usage (%.1f s):" % ((peak[0] - records[0][0]) / 1000.0))
+    print("%-10s %8s %10s  %s" % ("caller", "blocks", "memory", "symbol"))
+    callers = live_at(records, result["peak_index"])
+    for caller, (count, total) in sorted(callers.items(), key=lambda item: -item[1][1])[:args.top]:
+        print("0x%08x %8d %10d  %s" % (caller, count, total, symbolize(caller)))
+
+    if result["pool"] is not None:
+        pool_report(result["pool"])
+
+    timing_report(timings)
+
+    if args.sample_rate and args.sample_rate > 1:
+        sampling_report(records, result["peak_index"], args.sample_rate, args.top)
+
+    if incomplete:
+        print("\n%s" % incomplete)
+
+
+if __name__ == "__main__":
+    main()
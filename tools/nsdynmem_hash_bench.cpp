@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2021 Pelion. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the nanostack dynamic memory tracker block index hash.
+ *
+ * Compares the lowbias32 hash of nanostack_dynmemtracker.cpp against the MD5 hash it replaced, on
+ * heap block address sets modelled after the nanostack heap and the size class pools. Reports the
+ * home slot collision rate and linear probe lengths of the ext memory blocks table at the tracker
+ * table sizes and loads, and the time per hash. MD5 is a self-contained RFC 1321 implementation
+ * called the way the old hash called mbedtls_md5, so the host needs no mbedtls.
+ *
+ *   g++ -O2 -o nsdynmem_hash_bench tools/nsdynmem_hash_bench.cpp && ./nsdynmem_hash_bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#define HEAP_BASE           0x20020000u
+#define BENCH_ITERATIONS    10000000
+
+typedef uint32_t index_hash_t(void *block, uint32_t ext_mem_blocks_count);
+
+typedef struct md5_context {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t buffer[64];
+    size_t buffered;
+} md5_context;
+
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint8_t md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_block(md5_context *ctx, const uint8_t *block)
+{
+    uint32_t w[16];
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] | (uint32_t)block[i * 4 + 1] << 8 | (uint32_t)block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+    }
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t t = d;
+        d = c;
+        c = b;
+        uint32_t x = a + f + md5_k[i] + w[g];
+        b = b + ((x << md5_r[i]) | (x >> (32 - md5_r[i])));
+        a = t;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+}
+
+static void md5_starts(md5_context *ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+static void md5_update(md5_context *ctx, const uint8_t *data, size_t length)
+{
+    ctx->length += length;
+    while (length--) {
+        ctx->buffer[ctx->buffered++] = *data++;
+        if (ctx->buffered == 64) {
+            md5_block(ctx, ctx->buffer);
+            ctx->buffered = 0;
+        }
+    }
+}
+
+static void md5_finish(md5_context *ctx, uint8_t output[16])
+{
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad = 0x80;
+
+    md5_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->buffered != 56) {
+        md5_update(ctx, &pad, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->buffer[56 + i] = (uint8_t)(bits >> (8 * i));
+    }
+    md5_block(ctx, ctx->buffer);
+    for (int i = 0; i < 16; i++) {
+        output[i] = (uint8_t)(ctx->state[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+/* Hash before the integer hash, including the mask of the initial table size */
+static uint32_t md5_index_hash(void *block, uint32_t ext_mem_blocks_count)
+{
+    static md5_context ctx;
+    static uint8_t output[16];
+    uint32_t ret_value;
+    uint32_t number = (uint32_t)(uintptr_t)block;
+
+    memset(&ctx, 0, sizeof(ctx));
+    md5_starts(&ctx);
+    md5_update(&ctx, (const uint8_t *)&number, sizeof(number));
+    md5_finish(&ctx, output);
+
+    ret_value = (uint32_t)output[0] << 24 | (uint32_t)output[1] << 16 | (uint32_t)output[2] << 8 | output[3];
+    ret_value &= ext_mem_blocks_count & ~1;
+    if (ret_value >= ext_mem_blocks_count) {
+        ret_value = 0;
+    }
+    return ret_value;
+}
+
+/* Same as ns_dyn_mem_tracker_mem_block_index_hash() */
+static uint32_t lowbias32_index_hash(void *block, uint32_t ext_mem_blocks_count)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)block >> 2);
+
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68b;
+    hash ^= hash >> 16;
+
+    return (uint32_t)(((uint64_t)hash * ext_mem_blocks_count) >> 32);
+}
+
+/* Nanostack heap blocks, sizes of common allocations with the 4 byte head and tail of nsdynmem */
+static std::vector<uint32_t> heap_addresses(size_t count)
+{
+    static const uint32_t sizes[] = {12, 16, 20, 24, 32, 40, 48, 64, 96, 128, 200, 256, 512, 1280};
+    std::vector<uint32_t> addresses;
+    uint32_t offset = 0;
+
+    srand(1);
+    while (addresses.size() < count) {
+        uint32_t size = sizes[rand() % (sizeof(sizes) / sizeof(sizes[0]))] + 8;
+        addresses.push_back(HEAP_BASE + offset + 4);
+        offset += size;
+    }
+    return addresses;
+}
+
+/* Size class pool blocks, fixed size blocks in slabs */
+static std::vector<uint32_t> pool_addresses(size_t count, uint32_t block_size)
+{
+    std::vector<uint32_t> addresses;
+
+    for (size_t i = 0; i < count; i++) {
+        addresses.push_back(HEAP_BASE + (uint32_t)i * block_size);
+    }
+    return addresses;
+}
+
+static void table_stats(const char *name, index_hash_t *hash, const std::vector<uint32_t> &addresses, uint32_t table_size, uint32_t load_percent)
+{
+    std::vector<uint8_t> used(table_size, 0);
+    std::vector<uint8_t> home(table_size, 0);
+    size_t count = (size_t)table_size * load_percent / 100;
+    size_t collisions = 0;
+    uint64_t probes = 0;
+    uint32_t max_probe = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t index = hash((void *)(uintptr_t)addresses[i], table_size);
+        uint32_t probe = 0;
+        if (home[index]) {
+            collisions++;
+        }
+        home[index] = 1;
+        // Linear probing of the tracker library
+        while (used[index]) {
+            index = (index + 1) % table_size;
+            probe++;
+        }
+        used[index] = 1;
+        probes += probe;
+        if (probe > max_probe) {
+            max_probe = probe;
+        }
+    }
+    printf("  %-9s %5u slots %3u%% load: collisions %5.1f%%  mean probe %7.2f  max probe %5u\n",
+           name, table_size, load_percent, 100.0 * collisions / count, (double)probes / count, max_probe);
+}
+
+/* Collision rate of a uniformly random hash at the load for reference */
+static void ideal_stats(uint32_t table_size, uint32_t load_percent)
+{
+    double load = load_percent / 100.0;
+
+    printf("  %-9s %5u slots %3u%% load: collisions %5.1f%%  mean probe %7.2f\n",
+           "uniform", table_size, load_percent, 100.0 * (1.0 - (1.0 - exp(-load)) / load),
+           // Knuth, successful search of linear probing, minus the home slot
+           0.5 * (1.0 + 1.0 / (1.0 - load)) - 1.0);
+}
+
+static void timing(const char *name, index_hash_t *hash, const std::vector<uint32_t> &addresses)
+{
+    volatile uint32_t sink = 0;
+    size_t mask = addresses.size() - 1;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        sink += hash((void *)(uintptr_t)addresses[i & mask], 2047);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    printf("  %-9s %8.2f ns/op\n", name, elapsed.count() / BENCH_ITERATIONS);
+    (void)sink;
+}
+
+int main(void)
+{
+    // Initial table and the first two grow steps with the default configuration
+    static const uint32_t table_sizes[] = {2047, 3071, 4095};
+    static const uint32_t loads[] = {50, 75};
+    std::vector<uint32_t> heap = heap_addresses(4096);
+    std::vector<uint32_t> pool = pool_addresses(4096, 32);
+
+    printf("Nanostack heap blocks\n");
+    for (uint32_t size : table_sizes) {
+        for (uint32_t load : loads) {
+            ideal_stats(size, load);
+            table_stats("md5", md5_index_hash, heap, size, load);
+            table_stats("lowbias32", lowbias32_index_hash, heap, size, load);
+        }
+    }
+    printf("32 byte size class pool blocks\n");
+    for (uint32_t size : table_sizes) {
+        for (uint32_t load : loads) {
+            ideal_stats(size, load);
+            table_stats("md5", md5_index_hash, pool, size, load);
+            table_stats("lowbias32", lowbias32_index_hash, pool, size, load);
+        }
+    }
+    printf("Hash time\n");
+    timing("md5", md5_index_hash, heap);
+    timing("lowbias32", lowbias32_index_hash, heap);
+    return 0;
+}
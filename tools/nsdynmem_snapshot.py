@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright 2021 Pelion
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ----------------------------------------------------------------------------
+"""
+Decodes nanostack dynamic memory tracker snapshots.
+
+Snapshots are read from the binary value of resource 33455/0/22 or from a
+serial log of an application built with nsdynmemtracker-binary-trace, where
+they are traced as "NSDYNMEM snapshot <sequence> <part>/<parts>: <base64>".
+
+    nsdynmem_snapshot.py decode log.txt --elf BUILD/pelion-border-router.elf
+    nsdynmem_snapshot.py diff old.bin new.bin --map BUILD/pelion-border-router.map
+"""
+
+import argparse
+import base64
+import bisect
+import re
+import struct
+import subprocess
+import sys
+
+MAGIC = 0x544D534E
+VERSION = 1
+HEADER = struct.Struct("<IBBHIHH")
+RECORD = struct.Struct("<IIIIB3x")
+LISTS = {0: "top", 1: "to-permanent", 2: "permanent"}
+TRACE_LINE = re.compile(r"NSDYNMEM snapshot (\d+) (\d+)/(\d+): ([A-Za-z0-9+/=]+)")
+
+
+class Snapshot:
+    def __init__(self, data):
+        if len(data) < HEADER.size:
+            raise ValueError("snapshot is too short")
+        magic, version, record_size, count, total, sample_rate, sequence = HEADER.unpack_from(data)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("not a version %d memory tracker snapshot" % VERSION)
+        if record_size < RECORD.size or len(data) < HEADER.size + count * record_size:
+            raise ValueError("snapshot is truncated")
+        self.total_memory = total
+        self.sample_rate = sample_rate
+        self.sequence = sequence
+        self.records = []
+        for index in range(count):
+            caller, alloc_count, memory, lifetime, list_id = RECORD.unpack_from(data, HEADER.size + index * record_size)
+            self.records.append({
+                "list": LISTS.get(list_id, str(list_id)),
+                "caller": caller,
+                "count": alloc_count,
+                "memory": memory,
+                "lifetime": lifetime,
+            })
+
+
+def read_snapshots(path):
+    """Returns snapshots of a binary file or of a serial log, oldest first."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] == struct.pack("<I", MAGIC):
+        return [Snapshot(data)]
+
+    snapshots = []
+    parts = {}
+    for line in data.decode("utf-8", "replace").splitlines():
+        match = TRACE_LINE.search(line)
+        if not match:
+            continue
+        sequence, part, total = int(match.group(1)), int(match.group(2)), int(match.group(3))
+        if part == 1:
+            parts = {}
+        parts[part] = base64.b64decode(match.group(4))
+        if part == total and len(parts) == total:
+            snapshots.append(Snapshot(b"".join(parts[i] for i in range(1, total + 1))))
+            parts = {}
+    if not snapshots:
+        raise ValueError("no complete snapshot in %s" % path)
+    return snapshots
+
+
+class Symbolizer:
+    def __init__(self, elf=None, map_file=None, addr2line="arm-none-eabi-addr2line"):
+        self.cache = {}
+        self.elf = elf
+        self.addr2line = addr2line
+        self.symbols = []
+        if map_file:
+            self.symbols = self._parse_map(map_file)
+            self.addresses = [symbol[0] for symbol in self.symbols]
+
+    @staticmethod
+    def _parse_map(path):
+        """Collects .text input sections of a GCC map file."""
+        symbols = []
+        pending = None
+        section = re.compile(r"^ \.text\.(\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+))?")
+        continuation = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)")
+        with open(path) as f:
+            for line in f:
+                match = section.match(line)
+                if match:
+                    if match.group(2):
+                        symbols.append((int(match.group(2), 16), int(match.group(3), 16), match.group(1), match.group(4)))
+                        pending = None
+                    else:
+                        # Long section names continue on the next line
+                        pending = match.group(1)
+                    continue
+                if pending:
+                    match = continuation.match(line)
+                    if match:
+                        symbols.append((int(match.group(1), 16), int(match.group(2), 16), pending, match.group(3)))
+                    pending = None
+        symbols.sort()
+        return symbols
+
+    def __call__(self, address):
+        if address in self.cache:
+            return self.cache[address]
+        # Return address of a Thumb BL, look up the call instruction
+        lookup = (address & ~1) - 2
+        name = ""
+        if self.elf:
+            try:
+                output = subprocess.run([self.addr2line, "-f", "-C", "-s", "-e", self.elf, hex(lookup)],
+                                        capture_output=True, text=True, check=True).stdout.split("\n")
+                name = "%s %s" % (output[0], output[1])
+            except (OSError, subprocess.CalledProcessError) as error:
+                sys.exit("addr2line failed: %s" % error)
+        elif self.symbols:
+            index = bisect.bisect_right(self.addresses, lookup) - 1
+            if index >= 0:
+                start, size, symbol, obj = self.symbols[index]
+                if lookup < start + size:
+                    name = "%s+0x%x %s" % (symbol, lookup - start, obj.split("/")[-1])
+        self.cache[address] = name
+        return name
+
+
+def decode(args, symbolize):
+    snapshots = read_snapshots(args.snapshot)
+    for snapshot in snapshots if args.all else snapshots[-1:]:
+        print("snapshot %d total memory %d sample rate 1/%d" % (snapshot.sequence, snapshot.total_memory, snapshot.sample_rate))
+        print("%-13s %-10s %8s %10s %9s  %s" % ("list", "caller", "count", "memory", "lifetime", "symbol"))
+        for record in snapshot.records:
+            print("%-13s 0x%08x %8d %10d %9d  %s" % (record["list"], record["caller"], record["count"],
+                                                   record["memory"], record["lifetime"], symbolize(record["caller"])))
+        print()
+
+
+def diff(args, symbolize):
+    old = read_snapshots(args.old)[-1]
+    new = read_snapshots(args.new)[-1]
+    old_records = {(r["list"], r["caller"]): r for r in old.records}
+    new_records = {(r["list"], r["caller"]): r for r in new.records}
+
+    print("snapshot %d -> %d total memory %+d" % (old.sequence, new.sequence, new.total_memory - old.total_memory))
+    print("%-13s %-10s %9s %11s  %s" % ("list", "caller", "count", "memory", "symbol"))
+    rows = []
+    for key in set(old_records) | set(new_records):
+        old_record = old_records.get(key, {"count": 0, "memory": 0})
+        new_record = new_records.get(key, {"count": 0, "memory": 0})
+        rows.append((new_record["memory"] - old_record["memory"], new_record["count"] - old_record["count"], key))
+    for memory, count, (list_name, caller) in sorted(rows, key=lambda row: -abs(row[0])):
+        if memory or count:
+            print("%-13s 0x%08x %+9d %+11d  %s" % (list_name, caller, count, memory, symbolize(caller)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--elf", help="application ELF file for addr2line symbolization")
+    parser.add_argument("--map", help="application map file for symbolization without toolchain")
+    parser.add_argument("--addr2line", default="arm-none-eabi-addr2line", help="addr2line executable")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    decode_parser = commands.add_parser("decode", help="print a snapshot")
+    decode_parser.add_argument("snapshot", help="binary snapshot or serial log")
+    decode_parser.add_argument("--all", action="store_true", help="print every snapshot of a log, not only the last one")
+
+    diff_parser = commands.add_parser("diff", help="print changes between two snapshots")
+    diff_parser.add_argument("old", help="binary snapshot or serial log, last snapshot is used")
+    diff_parser.add_argument("new", help="binary snapshot or serial log, last snapshot is used")
+
+    args = parser.parse_args()
+    symbolize = Symbolizer(args.elf, args.map, args.addr2line)
+    try:
+        if args.command == "decode":
+            decode(args, symbolize)
+        else:
+            diff(args, symbolize)
+    except (OSError, ValueError) as error:
+        sys.exit(str(error))
+
+
+if __name__ == "__main__":
+    main()